@@ -0,0 +1,594 @@
+// Throughput and tail latency of AlpacaRequestEngine against the mock Alpaca server.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run
+//
+//   alpaca_poll_bench [--devices 1,10,50,100,250,500] [--requests 2000] [--latency-ms 0] [--output bench.json]
+//
+// Every scenario runs once per device count and prints one JSON object per line:
+//
+//   get           one GET per device at once, with the URL and query string AlpacaBase would build
+//   put           one PUT /calibratoron with a form body per device at once
+//   engine-batch  three GETs per device on the engine, each set completing with its last response
+//   mgmt-query    a hand-written UDP probe followed by the two management queries of a server
+//
+// The device classes and discovery are not built into the benchmark, so every scenario drives
+// AlpacaRequestEngine directly. AlpacaBase's endpoint statistics, request trace, change filter and
+// dispatcher hop, AlpacaCoverCalibrator::TimerHit and Loader::discover never run. engine-batch only
+// mirrors the batching of AlpacaBase::doDeviceGetBatchAsync and mgmt-query the requests of the Loader, so
+// throughput and allocations per request are engine level numbers, a lower bound for the driver.
+//
+// Each mock server runs in a child process forked before the engine starts, so CPU time and allocations
+// only count the engine side. Latencies are from submit to the callback on the dispatching thread.
+
+#include "dispatcher.h"
+#include "formencoder.h"
+#include "requestengine.h"
+#include "transport.h"
+#include "mock/mockserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_REQUESTS 2000 // Per scenario and device count, at least one round is always run
+#define BENCH_MGMT_QUERY_ROUNDS 20
+#define BENCH_TIMEOUT_MS 5000
+
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+struct MockProcess
+{
+    pid_t pid;
+    int devices;
+    uint16_t port;
+    uint16_t discoveryPort;
+    int stopFd; // Closing it stops the child
+};
+
+// Forks a mock server with the given number of CoverCalibrators, must run before any thread is started.
+static bool startMock(int devices, int latencyMs, const std::vector<MockProcess> &started, MockProcess &mock)
+{
+    int ready[2];
+    int stop[2];
+
+    if (pipe(ready) != 0 || pipe(stop) != 0)
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+
+    if (pid == 0)
+    {
+        close(ready[0]);
+        close(stop[1]);
+
+        // Otherwise the earlier mocks would never see their control pipe close.
+        for (const MockProcess &other : started)
+            close(other.stopFd);
+
+        MockAlpacaOptions options;
+        options.port = 0;
+        options.discoveryPort = 0;
+        options.coverCalibrators = devices;
+        options.domes = 0;
+        options.latencyMs = latencyMs;
+
+        MockAlpacaServer server(options);
+        uint16_t ports[2] = { 0, 0 };
+
+        if (server.start())
+        {
+            ports[0] = server.port();
+            ports[1] = server.discoveryPort();
+        }
+
+        ssize_t rc = write(ready[1], ports, sizeof(ports));
+        (void)rc;
+        close(ready[1]);
+
+        // Serve until the parent closes its end or exits.
+        char c;
+        while (read(stop[0], &c, 1) > 0)
+            ;
+
+        server.stop();
+        _exit(0);
+    }
+
+    close(ready[1]);
+    close(stop[0]);
+
+    uint16_t ports[2] = { 0, 0 };
+    ssize_t rc = read(ready[0], ports, sizeof(ports));
+    close(ready[0]);
+
+    mock.pid = pid;
+    mock.devices = devices;
+    mock.port = ports[0];
+    mock.discoveryPort = ports[1];
+    mock.stopFd = stop[1];
+
+    return rc == sizeof(ports) && mock.port != 0;
+}
+
+static void stopMock(MockProcess &mock)
+{
+    close(mock.stopFd);
+    waitpid(mock.pid, nullptr, 0);
+}
+
+static double cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Counters of one scenario run, everything between begin() and end() is measured.
+ */
+struct Measurement
+{
+    std::vector<double> latencies;
+    size_t requests = 0;
+    size_t failures = 0;
+    size_t polls = 0;
+
+    unsigned long long allocationsBefore = 0;
+    double cpuBefore = 0;
+    std::chrono::steady_clock::time_point started;
+
+    unsigned long long allocated = 0;
+    double cpu = 0;
+    double seconds = 0;
+
+    void begin(size_t expected)
+    {
+        latencies.reserve(expected);
+        allocationsBefore = allocations;
+        cpuBefore = cpuSeconds();
+        started = std::chrono::steady_clock::now();
+    }
+
+    void end()
+    {
+        seconds = millisecondsSince(started) / 1000.0;
+        cpu = cpuSeconds() - cpuBefore;
+        allocated = allocations - allocationsBefore;
+    }
+
+    double percentile(double p)
+    {
+        if (latencies.empty())
+            return 0;
+
+        std::sort(latencies.begin(), latencies.end());
+
+        size_t index = static_cast<size_t>(p * (latencies.size() - 1) + 0.5);
+        return latencies[index];
+    }
+};
+
+static FILE *output = stdout;
+
+static void report(const char *scenario, int devices, Measurement &m)
+{
+    double requests = m.requests > 0 ? m.requests : 1;
+
+    fprintf(output,
+            "{\"scenario\":\"%s\",\"devices\":%d,\"requests\":%zu,\"failures\":%zu,\"seconds\":%.4f,"
+            "\"rps\":%.1f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"allocs_per_request\":%.2f,\"cpu_us_per_request\":%.2f",
+            scenario, devices, m.requests, m.failures, m.seconds, m.requests / m.seconds, m.percentile(0.50),
+            m.percentile(0.99), m.allocated / requests, m.cpu * 1e6 / requests);
+
+    if (m.polls > 0)
+        fprintf(output, ",\"cpu_us_per_poll\":%.2f", m.cpu * 1e6 / m.polls);
+
+    fprintf(output, "}\n");
+    fflush(output);
+}
+
+// Runs the dispatcher until outstanding reaches 0, false on timeout.
+static bool waitFor(const size_t &outstanding)
+{
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    while (outstanding > 0)
+    {
+        if (millisecondsSince(started) > BENCH_TIMEOUT_MS)
+            return false;
+
+        AlpacaDispatcher::wait(100);
+    }
+
+    return true;
+}
+
+static uint32_t transactionId = 0;
+
+static void buildGet(AlpacaRequest &request, const std::string &deviceUrl, const char *path)
+{
+    request.method = AlpacaRequest::GET;
+    request.parse = AlpacaRequest::ENVELOPE;
+    request.transactionId = ++transactionId;
+
+    request.url.append(deviceUrl);
+    request.url.append(path);
+    request.url.append("?ClientID=1&ClientTransactionID=");
+    request.url.appendNumber(request.transactionId);
+}
+
+static size_t roundsFor(int devices, size_t requests, size_t perDevice)
+{
+    size_t rounds = requests / (devices * perDevice);
+
+    return rounds > 0 ? rounds : 1;
+}
+
+static void benchGet(std::shared_ptr<AlpacaTransport> transport, const std::vector<std::string> &deviceUrls,
+                     size_t requests)
+{
+    int devices = deviceUrls.size();
+    size_t rounds = roundsFor(devices, requests, 1);
+
+    Measurement m;
+    m.begin(rounds * devices);
+
+    for (size_t round = 0; round < rounds; round++)
+    {
+        size_t outstanding = devices;
+
+        for (const std::string &deviceUrl : deviceUrls)
+        {
+            AlpacaRequest request;
+            buildGet(request, deviceUrl, "/brightness");
+
+            std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+
+            AlpacaRequestEngine::instance().submit(transport, std::move(request), [&m, &outstanding,
+                                                   submitted](AlpacaResponse &response)
+            {
+                m.latencies.push_back(millisecondsSince(submitted));
+                m.requests++;
+
+                if (!response.envelope.ok || response.envelope.errorNumber != 0)
+                    m.failures++;
+
+                outstanding--;
+            });
+        }
+
+        if (!waitFor(outstanding))
+        {
+            fprintf(stderr, "get: timed out with %zu requests outstanding\n", outstanding);
+            exit(1);
+        }
+    }
+
+    m.end();
+    report("get", devices, m);
+}
+
+static void benchPut(std::shared_ptr<AlpacaTransport> transport, const std::vector<std::string> &deviceUrls,
+                     size_t requests)
+{
+    int devices = deviceUrls.size();
+    size_t rounds = roundsFor(devices, requests, 1);
+
+    // Connect every device first, the mock refuses commands to disconnected devices.
+    for (const std::string &deviceUrl : deviceUrls)
+    {
+        AlpacaRequest request;
+        request.method = AlpacaRequest::PUT;
+        request.parse = AlpacaRequest::ENVELOPE;
+        request.url.append(deviceUrl);
+        request.url.append("/connected");
+        request.body.add("Connected", true);
+
+        AlpacaRequestEngine::instance().perform(transport, std::move(request));
+    }
+
+    Measurement m;
+    m.begin(rounds * devices);
+
+    for (size_t round = 0; round < rounds; round++)
+    {
+        size_t outstanding = devices;
+
+        for (const std::string &deviceUrl : deviceUrls)
+        {
+            AlpacaRequest request;
+            request.method = AlpacaRequest::PUT;
+            request.parse = AlpacaRequest::ENVELOPE;
+            request.priority = AlpacaRequest::COMMAND;
+            request.transactionId = ++transactionId;
+            request.url.append(deviceUrl);
+            request.url.append("/calibratoron");
+            request.body.add("Brightness", int32_t(round % 256));
+            request.body.add("ClientID", uint32_t(1));
+            request.body.add("ClientTransactionID", request.transactionId);
+
+            std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+
+            AlpacaRequestEngine::instance().submit(transport, std::move(request), [&m, &outstanding,
+                                                   submitted](AlpacaResponse &response)
+            {
+                m.latencies.push_back(millisecondsSince(submitted));
+                m.requests++;
+
+                if (!response.envelope.ok || response.envelope.errorNumber != 0)
+                    m.failures++;
+
+                outstanding--;
+            });
+        }
+
+        if (!waitFor(outstanding))
+        {
+            fprintf(stderr, "put: timed out with %zu requests outstanding\n", outstanding);
+            exit(1);
+        }
+    }
+
+    m.end();
+    report("put", devices, m);
+}
+
+static void benchEngineBatch(std::shared_ptr<AlpacaTransport> transport, const std::vector<std::string> &deviceUrls,
+                             size_t requests)
+{
+    static const char *endpoints[] = { "/coverstate", "/calibratorstate", "/brightness" };
+    const size_t perPoll = sizeof(endpoints) / sizeof(endpoints[0]);
+
+    int devices = deviceUrls.size();
+    size_t rounds = roundsFor(devices, requests, perPoll);
+
+    Measurement m;
+    m.begin(rounds * devices);
+
+    for (size_t round = 0; round < rounds; round++)
+    {
+        size_t outstanding = devices;
+
+        for (const std::string &deviceUrl : deviceUrls)
+        {
+            // As AlpacaBase::doDeviceGetBatchAsync, the poll completes when its last response arrives.
+            struct Poll
+            {
+                std::chrono::steady_clock::time_point submitted;
+                size_t remaining;
+                bool failed;
+                int values[3];
+            };
+
+            std::shared_ptr<Poll> poll = std::make_shared<Poll>();
+            poll->submitted = std::chrono::steady_clock::now();
+            poll->remaining = perPoll;
+            poll->failed = false;
+
+            for (size_t i = 0; i < perPoll; i++)
+            {
+                AlpacaRequest request;
+                buildGet(request, deviceUrl, endpoints[i]);
+
+                AlpacaRequestEngine::instance().submit(transport, std::move(request), [&m, &outstanding, poll,
+                                                       i](AlpacaResponse &response)
+                {
+                    m.requests++;
+
+                    if (!response.envelope.ok || response.envelope.errorNumber != 0)
+                        poll->failed = true;
+                    else
+                        poll->values[i] = response.envelope.asInt();
+
+                    if (--poll->remaining > 0)
+                        return;
+
+                    m.latencies.push_back(millisecondsSince(poll->submitted));
+                    m.polls++;
+
+                    if (poll->failed)
+                        m.failures++;
+
+                    outstanding--;
+                });
+            }
+        }
+
+        if (!waitFor(outstanding))
+        {
+            fprintf(stderr, "engine-batch: timed out with %zu polls outstanding\n", outstanding);
+            exit(1);
+        }
+    }
+
+    m.end();
+    report("engine-batch", devices, m);
+}
+
+static void benchMgmtQuery(std::shared_ptr<AlpacaTransport> transport, const MockProcess &mock)
+{
+    std::string baseUrl = transport->baseUrl();
+
+    Measurement m;
+    m.begin(BENCH_MGMT_QUERY_ROUNDS);
+
+    for (int round = 0; round < BENCH_MGMT_QUERY_ROUNDS; round++)
+    {
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        bool ok = false;
+
+        int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(mock.discoveryPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        sendto(s, "alpacadiscovery1", 16, 0, (struct sockaddr *)&address, sizeof(address));
+
+        struct pollfd pfd = { s, POLLIN, 0 };
+        char reply[128];
+
+        if (poll(&pfd, 1, BENCH_TIMEOUT_MS) > 0 && recv(s, reply, sizeof(reply), 0) > 0)
+        {
+            // Both management queries together, as the discovery of the driver sends them.
+            AlpacaRequest description;
+            description.method = AlpacaRequest::GET;
+            description.url.append(baseUrl);
+            description.url.append("/management/v1/description");
+
+            AlpacaRequest configuredDevices;
+            configuredDevices.method = AlpacaRequest::GET;
+            configuredDevices.url.append(baseUrl);
+            configuredDevices.url.append("/management/v1/configureddevices");
+
+            std::future<AlpacaResponse> pendingDescription = AlpacaRequestEngine::instance().request(transport,
+                    std::move(description));
+            std::future<AlpacaResponse> pendingDevices = AlpacaRequestEngine::instance().request(transport,
+                    std::move(configuredDevices));
+
+            nlohmann::json server = pendingDescription.get().document;
+            nlohmann::json devices = pendingDevices.get().document;
+
+            ok = server.is_object() && devices.is_object() && devices["Value"].is_array() &&
+                 int(devices["Value"].size()) == mock.devices;
+        }
+
+        close(s);
+
+        m.latencies.push_back(millisecondsSince(started));
+        m.requests++;
+
+        if (!ok)
+            m.failures++;
+    }
+
+    m.end();
+    report("mgmt-query", mock.devices, m);
+}
+
+static std::vector<int> parseCounts(const char *text)
+{
+    std::vector<int> counts;
+
+    while (*text != 0)
+    {
+        char *end = nullptr;
+        long count = strtol(text, &end, 10);
+
+        if (end == text || count <= 0)
+            break;
+
+        counts.push_back(count);
+        text = *end == ',' ? end + 1 : end;
+    }
+
+    return counts;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> counts = { 1, 10, 50, 100, 250, 500 };
+    size_t requests = BENCH_DEFAULT_REQUESTS;
+    int latencyMs = 0;
+    const char *outputPath = nullptr;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--devices") == 0)
+            counts = parseCounts(argv[i + 1]);
+        else if (strcmp(argv[i], "--requests") == 0)
+            requests = strtoul(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "--latency-ms") == 0)
+            latencyMs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--output") == 0)
+            outputPath = argv[i + 1];
+    }
+
+    if (outputPath != nullptr && (output = fopen(outputPath, "w")) == nullptr)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    // All mocks first, forking once the engine thread runs would copy a process mid request.
+    std::vector<MockProcess> mocks;
+
+    for (int count : counts)
+    {
+        MockProcess mock;
+
+        if (!startMock(count, latencyMs, mocks, mock))
+        {
+            fprintf(stderr, "Unable to start a mock server with %d devices\n", count);
+            return 1;
+        }
+
+        mocks.push_back(mock);
+    }
+
+    AlpacaDispatcher::init();
+
+    for (MockProcess &mock : mocks)
+    {
+        std::shared_ptr<AlpacaTransport> transport = AlpacaTransport::forServer("127.0.0.1", mock.port);
+
+        // Built once per device as AlpacaBase does.
+        std::vector<std::string> deviceUrls;
+        for (int i = 0; i < mock.devices; i++)
+            deviceUrls.push_back(transport->baseUrl() + "/api/v1/covercalibrator/" + std::to_string(i));
+
+        benchGet(transport, deviceUrls, requests);
+        benchPut(transport, deviceUrls, requests);
+        benchEngineBatch(transport, deviceUrls, requests);
+        benchMgmtQuery(transport, mock);
+
+        stopMock(mock);
+    }
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
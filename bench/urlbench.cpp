@@ -0,0 +1,90 @@
+// Compares building a poll URL by string concatenation, as AlpacaBase used to, with AlpacaUrl.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run alpaca_url_bench [iterations].
+
+#include "requesturl.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static const std::string baseUrl = "http://192.168.100.123:11111";
+static const std::string deviceType = "covercalibrator";
+static const uint32_t deviceNumber = 0;
+static const uint32_t clientId = 4242;
+
+static size_t sink = 0;
+
+static void concatenated(uint32_t transactionId)
+{
+    std::string deviceUrl = "/api/v1/" + deviceType + "/" + std::to_string(deviceNumber) + "/calibratorstate";
+    std::string url = baseUrl + deviceUrl + "?ClientID=" + std::to_string(clientId) + "&ClientTransactionID=" +
+                      std::to_string(transactionId);
+
+    sink += url.size();
+}
+
+static void buffered(const std::string &deviceUrl, uint32_t transactionId)
+{
+    AlpacaUrl url;
+    url.append(deviceUrl);
+    url.append("/calibratorstate");
+    url.append("?ClientID=");
+    url.appendNumber(clientId);
+    url.append("&ClientTransactionID=");
+    url.appendNumber(transactionId);
+
+    sink += url.length();
+}
+
+template <typename F>
+static void run(const char *name, unsigned long iterations, F f)
+{
+    unsigned long long before = allocations;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    for (unsigned long i = 0; i < iterations; i++)
+        f(uint32_t(i));
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    unsigned long long allocated = allocations - before;
+
+    printf("%-14s %10.1f ns/url %8.2f allocations/url\n", name, ns / iterations, double(allocated) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    // Built once per device, as AlpacaBase does at construction.
+    const std::string deviceUrl = baseUrl + "/api/v1/" + deviceType + "/" + std::to_string(deviceNumber);
+
+    run("concatenated", iterations, concatenated);
+    run("buffered", iterations, [&deviceUrl](uint32_t transactionId)
+    {
+        buffered(deviceUrl, transactionId);
+    });
+
+    return sink == 0;
+}
@@ -1,7 +1,17 @@
 #include "base.h"
 #include "config.h"
-
+#include "storage.h"
+#include "trace.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <future>
 #include <memory>
+#include <random>
 #include <string>
 #include <stdexcept>
 
@@ -9,6 +19,34 @@
 
 using namespace INDI;
 
+// One ClientID for the whole driver. Alpaca reserves 0 for clients that do not identify themselves.
+static uint32_t driverClientId()
+{
+    static uint32_t clientId = []()
+    {
+        std::random_device random;
+        uint32_t id = random();
+
+        return id == 0 ? 1 : id;
+    }();
+
+    return clientId;
+}
+
+// Shared by every device, so a reply can be matched to its request no matter which device sent it.
+static uint32_t nextTransactionId()
+{
+    static std::atomic<uint32_t> transactionId(0);
+
+    uint32_t id = ++transactionId;
+
+    // 0 means no id, skip it when the counter wraps.
+    if (id == 0)
+        id = ++transactionId;
+
+    return id;
+}
+
 AlpacaBase::AlpacaBase(
     DefaultDevice *device,
     std::string serverName,
@@ -34,6 +72,62 @@ AlpacaBase::AlpacaBase(
     _uniqueId = uniqueId;
     _ipAddress = ipAddress;
     _port = port;
+    _clientId = driverClientId();
+    _transport = AlpacaTransport::forServer(_ipAddress, _port);
+    _deviceUrl = _transport->baseUrl() + "/api/v1/" + _deviceType + "/" + std::to_string(_deviceNumber);
+    _lifetime = std::make_shared<bool>(true);
+}
+
+void AlpacaBase::setServerAddress(const std::string &ipAddress, uint16_t port)
+{
+    if (ipAddress == _ipAddress && port == _port)
+        return;
+
+    DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_SESSION, "Server moved from %s:%d to %s:%d",
+                 _ipAddress.c_str(), _port, ipAddress.c_str(), port);
+
+    _ipAddress = ipAddress;
+    _port = port;
+    _transport = AlpacaTransport::forServer(_ipAddress, _port);
+    _deviceUrl = _transport->baseUrl() + "/api/v1/" + _deviceType + "/" + std::to_string(_deviceNumber);
+
+    // Could be another device now, or the same one with updated firmware.
+    _staticResponses.clear();
+}
+
+void AlpacaBase::retire()
+{
+    _lifetime.reset();
+    _device->deleteProperty(nullptr);
+}
+
+void AlpacaBase::schedulePoll()
+{
+    if (_pollTimerId != -1)
+        _device->RemoveTimer(_pollTimerId);
+
+    _pollTimerId = _device->SetTimer(_pollScheduler.interval(_device->getCurrentPollingPeriod()));
+}
+
+void AlpacaBase::kickPoll()
+{
+    _pollScheduler.kick();
+
+    // -1 while a poll is in flight, its completion picks up the fast interval.
+    if (_pollTimerId != -1)
+        schedulePoll();
+}
+
+void AlpacaBase::publishSwitch(ISwitchVectorProperty *svp)
+{
+    if (_published.changed(svp))
+        IDSetSwitch(svp, nullptr);
+}
+
+void AlpacaBase::publishNumber(INumberVectorProperty *nvp, double tolerance)
+{
+    if (_published.changed(nvp, tolerance))
+        IDSetNumber(nvp, nullptr);
 }
 
 bool AlpacaBase::initAlpacaBaseProperties()
@@ -72,78 +166,565 @@ bool AlpacaBase::initAlpacaBaseProperties()
     nameTP.fill(_device->getDeviceName(), "NAME", "Name", INFO_TAB, IP_RO, 60, IPS_IDLE);
     _device->registerProperty(nameTP);
 
+    traceSP[Trace::TRACE_DUMP].fill("TRACE_DUMP", "Dump", ISS_OFF);
+    traceSP.fill(_device->getDeviceName(), "REQUEST_TRACE", "Request Trace", INFO_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    _device->registerProperty(traceSP);
 
     return true;
 }
 
-nlohmann::json AlpacaBase::doGetRequest(const std::string url)
+void AlpacaBase::buildGetRequest(AlpacaRequest &request, const std::string &base, const char *path)
+{
+    request.method = AlpacaRequest::GET;
+    request.parse = AlpacaRequest::ENVELOPE;
+    request.transactionId = nextTransactionId();
+
+    request.url.append(base);
+    request.url.append(path);
+    request.url.append("?ClientID=");
+    request.url.appendNumber(_clientId);
+    request.url.append("&ClientTransactionID=");
+    request.url.appendNumber(request.transactionId);
+}
+
+bool AlpacaBase::processAlpacaBaseSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (dev == nullptr || strcmp(dev, _device->getDeviceName()) != 0)
+        return false;
+
+    if (traceSP.isNameMatch(name))
+    {
+        dumpTrace();
+        return true;
+    }
+
+    return false;
+}
+
+void AlpacaBase::dumpTrace()
+{
+    char fileName[64];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(fileName, sizeof(fileName), "alpaca_trace_%Y%m%d_%H%M%S.log", &local);
+
+    std::string path = alpacaStoragePath(fileName);
+
+    traceSP.reset();
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_ERROR, "Unable to write trace to %s: %s", path.c_str(),
+                     strerror(errno));
+        traceSP.setState(IPS_ALERT);
+        traceSP.apply();
+        return;
+    }
+
+    size_t records = AlpacaTrace::instance().dump(file);
+    fclose(file);
+
+    DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_SESSION, "Wrote %zu trace records to %s", records, path.c_str());
+
+    traceSP.setState(IPS_OK);
+    traceSP.apply();
+}
+
+AlpacaEnvelope AlpacaBase::performGet(const std::string &base, const char *path)
+{
+    AlpacaRequest request;
+    buildGetRequest(request, base, path);
+
+    AlpacaEndpointStats *stats = endpointStats(AlpacaRequest::GET, path);
+
+    AlpacaResponse response = AlpacaRequestEngine::instance().perform(_transport, std::move(request));
+    recordEndpoint(stats, response);
+
+    return response.envelope;
+}
+
+AlpacaEnvelope AlpacaBase::performPut(const std::string &base, const char *path, AlpacaForm &body,
+                                      AlpacaRequest::Priority priority)
+{
+    AlpacaRequest request;
+    request.method = AlpacaRequest::PUT;
+    request.priority = priority;
+    request.parse = AlpacaRequest::ENVELOPE;
+    request.transactionId = nextTransactionId();
+
+    body.add("ClientID", _clientId);
+    body.add("ClientTransactionID", request.transactionId);
+
+    request.url.append(base);
+    request.url.append(path);
+    request.body = body;
+
+    AlpacaEndpointStats *stats = endpointStats(AlpacaRequest::PUT, path);
+
+    AlpacaResponse response = AlpacaRequestEngine::instance().perform(_transport, std::move(request));
+    recordEndpoint(stats, response);
+
+    return response.envelope;
+}
+
+void AlpacaBase::submitGet(const std::string &base, const char *path, ResponseCallback callback)
+{
+    AlpacaRequest request;
+    buildGetRequest(request, base, path);
+
+    AlpacaEndpointStats *stats = endpointStats(AlpacaRequest::GET, path);
+
+    std::weak_ptr<bool> lifetime = _lifetime;
+
+    AlpacaRequestEngine::instance().submit(_transport, std::move(request), [this, lifetime, stats,
+                                                callback](AlpacaResponse &response)
+    {
+        if (lifetime.expired())
+            return;
+
+        recordEndpoint(stats, response);
+
+        callback(response.envelope);
+    });
+}
+
+AlpacaEndpointStats *AlpacaBase::endpointStats(AlpacaRequest::Method method, const char *path)
+{
+    for (const std::unique_ptr<AlpacaEndpointStats> &stats : _endpointStats)
+    {
+        if (stats->method == method && stats->path == path)
+            return stats.get();
+    }
+
+    // First call to the endpoint, its property is defined once a response has been recorded.
+    _endpointStats.emplace_back(new AlpacaEndpointStats(_device->getDeviceName(), method, path));
+
+    return _endpointStats.back().get();
+}
+
+void AlpacaBase::recordEndpoint(AlpacaEndpointStats *stats, const AlpacaResponse &response)
+{
+    stats->record(response);
+
+    int32_t status = response.envelope.ok ? response.envelope.errorNumber : -1;
+    AlpacaTrace::instance().record(_device->getDeviceName(), stats->method == AlpacaRequest::PUT, stats->path.c_str(),
+                                   response.timing.transactionId, status, response.timing.queued + response.timing.total);
+
+    publishEndpointStats(false);
+}
+
+void AlpacaBase::publishEndpointStats(bool force)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    // Polling several endpoints a second would otherwise flood clients with statistics.
+    if (!force && now - _statsPublished < std::chrono::milliseconds(ALPACA_STATS_PUBLISH_INTERVAL))
+        return;
+
+    _statsPublished = now;
+
+    for (const std::unique_ptr<AlpacaEndpointStats> &stats : _endpointStats)
+    {
+        if (!stats->dirty)
+            continue;
+
+        stats->update();
+
+        // Defined with its first response, entries still waiting for one stay unknown to clients.
+        if (stats->defined)
+            stats->property.apply();
+        else
+            _device->defineProperty(stats->property);
+
+        stats->defined = true;
+    }
+}
+
+AlpacaEnvelope AlpacaBase::doGetRequest(const char *url)
+{
+    return performGet(_transport->baseUrl(), url);
+}
+
+AlpacaEnvelope AlpacaBase::doPutRequest(const char *url, AlpacaForm &body, AlpacaRequest::Priority priority)
+{
+    return performPut(_transport->baseUrl(), url, body, priority);
+}
+
+void AlpacaBase::doGetRequestAsync(const char *url, ResponseCallback callback)
+{
+    submitGet(_transport->baseUrl(), url, callback);
+}
+
+void AlpacaBase::doDeviceGetRequestAsync(const char *url, ResponseCallback callback)
+{
+    submitGet(_deviceUrl, url, callback);
+}
+
+void AlpacaBase::doDeviceGetBatchAsync(const std::vector<const char *> &urls, BatchCallback callback)
+{
+    struct Batch
+    {
+        std::vector<AlpacaEnvelope> responses;
+        size_t remaining;
+        BatchCallback callback;
+    };
+
+    if (urls.empty())
+    {
+        std::vector<AlpacaEnvelope> responses;
+        callback(responses);
+        return;
+    }
+
+    // Every completion runs on the INDI thread, so the batch needs no locking.
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->responses.resize(urls.size());
+    batch->remaining = urls.size();
+    batch->callback = callback;
+
+    for (size_t i = 0; i < urls.size(); i++)
+    {
+        doDeviceGetRequestAsync(urls[i], [batch, i](AlpacaEnvelope &response)
+        {
+            batch->responses[i] = response;
+
+            if (--batch->remaining == 0)
+                batch->callback(batch->responses);
+        });
+    }
+}
+
+std::vector<AlpacaEnvelope> AlpacaBase::doDeviceGetBatch(const std::vector<const char *> &urls)
+{
+    std::vector<AlpacaEndpointStats *> stats;
+    std::vector<std::future<AlpacaResponse>> pending;
+
+    // Queue them all before waiting on any, so they share the connections of the server.
+    for (const char *url : urls)
+    {
+        AlpacaRequest request;
+        buildGetRequest(request, _deviceUrl, url);
+
+        stats.push_back(endpointStats(AlpacaRequest::GET, url));
+        pending.push_back(AlpacaRequestEngine::instance().request(_transport, std::move(request)));
+    }
+
+    std::vector<AlpacaEnvelope> responses;
+    responses.reserve(urls.size());
+
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        AlpacaResponse response = pending[i].get();
+        recordEndpoint(stats[i], response);
+
+        responses.push_back(response.envelope);
+    }
+
+    return responses;
+}
+
+// The static endpoints every device has, read ahead of the device's own.
+static std::vector<const char *> staticUrls(const std::vector<const char *> &deviceStatic)
+{
+    std::vector<const char *> urls =
+    {
+        Alpaca::Common::Description::path(),
+        Alpaca::Common::DriverInfo::path(),
+        Alpaca::Common::DriverVersion::path(),
+        Alpaca::Common::InterfaceVersion::path(),
+        Alpaca::Common::Name::path(),
+    };
+
+    urls.insert(urls.end(), deviceStatic.begin(), deviceStatic.end());
+
+    return urls;
+}
+
+std::vector<AlpacaEnvelope> AlpacaBase::loadStaticProperties(const std::vector<const char *> &deviceStatic,
+        const std::vector<const char *> &probes)
+{
+    std::vector<const char *> urls = staticUrls(deviceStatic);
+    size_t staticCount = urls.size();
+
+    urls.insert(urls.end(), probes.begin(), probes.end());
+
+    std::vector<AlpacaEnvelope> responses = doDeviceGetBatch(urls);
+
+    return storeStaticResponses(urls, responses, staticCount);
+}
+
+void AlpacaBase::loadStaticPropertiesAsync(const std::vector<const char *> &deviceStatic,
+        const std::vector<const char *> &probes, BatchCallback callback)
+{
+    std::vector<const char *> urls = staticUrls(deviceStatic);
+    size_t staticCount = urls.size();
+
+    urls.insert(urls.end(), probes.begin(), probes.end());
+
+    doDeviceGetBatchAsync(urls, [this, urls, staticCount, callback](std::vector<AlpacaEnvelope> &responses)
+    {
+        std::vector<AlpacaEnvelope> probeResponses = storeStaticResponses(urls, responses, staticCount);
+
+        callback(probeResponses);
+    });
+}
+
+std::vector<AlpacaEnvelope> AlpacaBase::storeStaticResponses(const std::vector<const char *> &urls,
+        const std::vector<AlpacaEnvelope> &responses, size_t staticCount)
+{
+    _staticResponses.clear();
+
+    for (size_t i = 0; i < staticCount; i++)
+        storeStaticResponse(urls[i], responses[i]);
+
+    updateStaticProperties();
+
+    return std::vector<AlpacaEnvelope>(responses.begin() + staticCount, responses.end());
+}
+
+AlpacaEnvelope *AlpacaBase::staticResponse(const char *path)
+{
+    for (StaticResponse &cached : _staticResponses)
+    {
+        if (cached.path == path)
+            return &cached.response;
+    }
+
+    return nullptr;
+}
+
+AlpacaEnvelope *AlpacaBase::storeStaticResponse(const char *path, const AlpacaEnvelope &response)
 {
-    std::string fullUrl = "http://" + _ipAddress + ":" + std::to_string(_port) + url + "?ClientID=" + std::to_string(_clientId) + "&ClientTransactionID=" + std::to_string(_clientTransactionId);
+    AlpacaEnvelope *cached = staticResponse(path);
+
+    if (cached == nullptr)
+    {
+        _staticResponses.push_back(StaticResponse());
+        _staticResponses.back().path = path;
+        cached = &_staticResponses.back().response;
+    }
 
-    return get_json(fullUrl.c_str());
+    *cached = response;
+
+    return cached;
 }
 
-nlohmann::json AlpacaBase::doPutRequest(const std::string url, std::map<std::string, std::string> &body)
+// Every profile lives in one file. Only the INDI thread reads or writes it, so it is loaded once and kept.
+static nlohmann::json &profiles()
 {
-    std::string fullUrl = "http://" + _ipAddress + ":" + std::to_string(_port) +  url;
+    static nlohmann::json doc = []()
+    {
+        nlohmann::json loaded = loadJsonFile(alpacaStoragePath(ALPACA_PROFILE_FILE));
 
-    body["ClientID"] = std::to_string(_clientId);
-    body["ClientTransactionID"] = std::to_string(_clientTransactionId);
+        return loaded.is_object() ? loaded : nlohmann::json::object();
+    }();
 
-    return put_json(fullUrl.c_str(), body);
+    return doc;
 }
 
-nlohmann::json AlpacaBase::doDeviceGetRequest(const std::string url)
+static nlohmann::json envelopeToJson(const AlpacaEnvelope &response)
 {
-    std::string deviceUrl = "/api/v1/" + _deviceType + "/" + std::to_string(_deviceNumber) + url;
+    return nlohmann::json
+    {
+        {"Ok", response.ok},
+        {"ErrorNumber", response.errorNumber},
+        {"ErrorMessage", response.errorMessage},
+        {"ValueType", static_cast<int>(response.valueType)},
+        {"Boolean", response.boolean},
+        {"Integer", response.integer},
+        {"Number", std::isfinite(response.number) ? response.number : 0.0},
+        {"Text", response.text},
+    };
+}
 
-    return doGetRequest(deviceUrl);
+static AlpacaEnvelope envelopeFromJson(const nlohmann::json &doc)
+{
+    AlpacaEnvelope response;
+    response.clear();
+
+    response.ok = doc.value("Ok", false);
+    response.errorNumber = doc.value("ErrorNumber", 0);
+    snprintf(response.errorMessage, sizeof(response.errorMessage), "%s", doc.value("ErrorMessage", "").c_str());
+    response.valueType = static_cast<AlpacaEnvelope::ValueType>(doc.value("ValueType", 0));
+    response.boolean = doc.value("Boolean", false);
+    response.integer = doc.value("Integer", int64_t(0));
+    response.number = doc.value("Number", 0.0);
+    snprintf(response.text, sizeof(response.text), "%s", doc.value("Text", "").c_str());
+
+    return response;
 }
 
-nlohmann::json AlpacaBase::doDevicePutRequest(const std::string url, std::map<std::string, std::string> &body)
+nlohmann::json AlpacaBase::restoreProfile()
 {
-    std::string deviceUrl = "/api/v1/" + _deviceType + "/" + std::to_string(_deviceNumber) + url;
+    nlohmann::json &doc = profiles();
+
+    if (!doc.contains(_uniqueId) || !doc[_uniqueId].is_object())
+        return nlohmann::json(nullptr);
+
+    const nlohmann::json &profile = doc[_uniqueId];
 
-    return doPutRequest(deviceUrl, body);
+    if (!profile.contains("Static") || !profile["Static"].is_object())
+        return nlohmann::json(nullptr);
+
+    _staticResponses.clear();
+
+    for (auto it = profile["Static"].begin(); it != profile["Static"].end(); ++it)
+        storeStaticResponse(it.key().c_str(), envelopeFromJson(it.value()));
+
+    updateStaticProperties();
+
+    DEBUGDEVICE(_device->getDeviceName(), INDI::Logger::DBG_DEBUG, "Restored the device profile, revalidating.");
+
+    return profile.value("Capabilities", nlohmann::json::object());
 }
 
-bool AlpacaBase::hasError(nlohmann::json &doc)
+void AlpacaBase::saveProfile(const nlohmann::json &capabilities)
 {
-    if (doc == nullptr)
+    nlohmann::json staticResponses = nlohmann::json::object();
+
+    for (const StaticResponse &cached : _staticResponses)
+        staticResponses[cached.path] = envelopeToJson(cached.response);
+
+    nlohmann::json profile =
     {
-        DEBUGDEVICE(_device->getDeviceName(), INDI::Logger::DBG_ERROR, "Non-200 response from Alpaca device.");
+        {"Static", staticResponses},
+        {"Capabilities", capabilities},
+    };
+
+    nlohmann::json &doc = profiles();
+
+    if (doc.value(_uniqueId, nlohmann::json(nullptr)) == profile)
+        return;
+
+    doc[_uniqueId] = profile;
+    saveJsonFile(alpacaStoragePath(ALPACA_PROFILE_FILE), doc);
+}
+
+void AlpacaBase::updateStaticProperties()
+{
+    Alpaca::Value<std::string> description = cached<Alpaca::Common::Description>();
+    deviceTP[Device::DEVICE_DESCRIPTION].setText(description.value);
+    deviceTP.setState(description.ok ? IPS_OK : IPS_ALERT);
+    deviceTP.apply();
+
+    Alpaca::Value<std::string> driverInfo = cached<Alpaca::Common::DriverInfo>();
+    driverInfoTP[DriverInfo::DRIVER_DESCRIPTION].setText(driverInfo.value);
+    driverInfoTP.setState(driverInfo.ok ? IPS_OK : IPS_ALERT);
+    driverInfoTP.apply();
+
+    Alpaca::Value<std::string> driverVersion = cached<Alpaca::Common::DriverVersion>();
+    driverVersionTP[DriverVersion::DRIVER_VERSION].setText(driverVersion.value);
+    driverVersionTP.setState(driverVersion.ok ? IPS_OK : IPS_ALERT);
+    driverVersionTP.apply();
+
+    Alpaca::Value<int> interfaceVersion = cached<Alpaca::Common::InterfaceVersion>();
+    interfaceVersionNP[InterfaceVersion::INTERFACE_VERSION].setValue(interfaceVersion.value);
+    interfaceVersionNP.setState(interfaceVersion.ok ? IPS_OK : IPS_ALERT);
+    interfaceVersionNP.apply();
+
+    Alpaca::Value<std::string> name = cached<Alpaca::Common::Name>();
+    nameTP[Name::NAME].setText(name.value);
+    nameTP.setState(name.ok ? IPS_OK : IPS_ALERT);
+    nameTP.apply();
+}
+
+AlpacaEnvelope AlpacaBase::doDeviceGetRequest(const char *url)
+{
+    return performGet(_deviceUrl, url);
+}
+
+AlpacaEnvelope AlpacaBase::doDevicePutRequest(const char *url, AlpacaForm &body, AlpacaRequest::Priority priority)
+{
+    return performPut(_deviceUrl, url, body, priority);
+}
+
+bool AlpacaBase::hasError(AlpacaEnvelope &response)
+{
+    if (!response.ok)
+    {
+        const char *deviceName = _device->getDeviceName();
+
+        switch (response.failure)
+        {
+        case AlpacaEnvelope::FAILURE_NOT_SENT:
+            DEBUGDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Request to Alpaca device not sent.");
+            break;
+        case AlpacaEnvelope::FAILURE_TRANSPORT:
+            DEBUGFDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Request to Alpaca device failed: %s",
+                         curl_easy_strerror(static_cast<CURLcode>(response.failureCode)));
+            break;
+        case AlpacaEnvelope::FAILURE_TIMEOUT:
+            DEBUGDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Request to Alpaca device ran past its deadline.");
+            break;
+        case AlpacaEnvelope::FAILURE_HTTP_STATUS:
+            DEBUGFDEVICE(deviceName, INDI::Logger::DBG_ERROR, "HTTP %ld response from Alpaca device.",
+                         response.failureCode);
+            break;
+        case AlpacaEnvelope::FAILURE_BAD_BODY:
+            DEBUGDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Empty or invalid response from Alpaca device.");
+            break;
+        case AlpacaEnvelope::FAILURE_MISMATCH:
+            DEBUGDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Reply from Alpaca device answered another request.");
+            break;
+        default:
+            DEBUGDEVICE(deviceName, INDI::Logger::DBG_ERROR, "Non-200 response from Alpaca device.");
+            break;
+        }
+
         return true;
     }
 
-    if (doc.contains("ErrorNumber") && doc["ErrorNumber"] > 0)
+    if (response.errorNumber > 0)
     {
-        DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_ERROR,"Error: %d %s", doc["ErrorNumber"].get<int>(), doc["ErrorMessage"].get<std::string>().c_str());
+        DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_ERROR,"Error: %d %s", response.errorNumber, response.errorMessage);
         return true;
     }
 
     return false;
 }
 
-bool AlpacaBase::putConnected(const bool connected)
+void AlpacaBase::logTransportStats()
 {
-    std::map<std::string, std::string> body;
-
-    body["Connected"] = connected;
+    AlpacaTransport::Stats stats = _transport->stats();
+
+    DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_DEBUG,
+                 "Transport %s:%d: %llu requests, %llu failures, %llu mismatched replies, %llu connections opened, %llu reused",
+                 _ipAddress.c_str(), _port,
+                 (unsigned long long)stats.requests, (unsigned long long)stats.failures,
+                 (unsigned long long)stats.mismatches,
+                 (unsigned long long)stats.connectionsOpened, (unsigned long long)stats.connectionsReused);
+
+    DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_DEBUG,
+                 "Transport %s:%d: %llu timeouts, %llu hedged GETs, %llu answered by the hedge first",
+                 _ipAddress.c_str(), _port,
+                 (unsigned long long)stats.timeouts, (unsigned long long)stats.hedges,
+                 (unsigned long long)stats.hedgesWon);
+
+    if (stats.requests == 0)
+        return;
+
+    // Server time includes one network round trip, network is connect plus receiving the body.
+    DEBUGFDEVICE(_device->getDeviceName(), INDI::Logger::DBG_DEBUG,
+                 "Transport %s:%d: mean %.2f ms queued, %.2f ms network, %.2f ms server, %.2f ms max round trip",
+                 _ipAddress.c_str(), _port,
+                 stats.queuedUs / 1000.0 / stats.requests, stats.networkUs / 1000.0 / stats.requests,
+                 stats.serverUs / 1000.0 / stats.requests, stats.maxTotalUs / 1000.0);
+}
 
-    auto response = doDevicePutRequest("/connected", body);
+bool AlpacaBase::putConnected(const bool connected)
+{
+    AlpacaForm body;
 
-    if (hasError(response))
-        return false;
+    body.add("Connected", connected);
 
-    return true;
+    return put<Alpaca::Common::SetConnected>(body);
 }
 
 bool AlpacaBase::getConnected()
 {
-    nlohmann::json response = doDeviceGetRequest("/connected");
+    Alpaca::Value<bool> connected = get<Alpaca::Common::Connected>();
 
-    if (hasError(response))
-        return false;
-
-    return true;
+    return connected.ok && connected.value;
 }
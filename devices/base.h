@@ -6,7 +6,20 @@
 #include <libindi/indibase.h>
 #include <libindi/indipropertytext.h>
 #include <libindi/indipropertynumber.h>
-#include "jsonRequest.h"
+#include <libindi/indipropertyswitch.h>
+#include <libindi/json.h>
+#include "requestengine.h"
+#include "transport.h"
+#include "endpoints.h"
+#include "endpointstats.h"
+#include "pollscheduler.h"
+#include "changefilter.h"
+
+#include <chrono>
+
+#include <functional>
+#include <memory>
+#include <vector>
 
 #define ALPACA_ERROR_NOT_IMPLEMENTED 0x400
 #define ALPACA_ERROR_INVALID_VALUE 0x401
@@ -17,6 +30,9 @@
 #define ALPACA_ERROR_INVALID_OPERATION 0x40B
 #define ALPACA_ERROR_ACTION_NOT_IMPLEMENTED 0x40C
 
+#define ALPACA_STATS_PUBLISH_INTERVAL 5000 // ms between updates of the endpoint statistics properties
+#define ALPACA_PROFILE_FILE "alpaca_profiles.json"
+
 namespace INDI
 {
 /**
@@ -42,9 +58,24 @@ public:
     );
     virtual ~AlpacaBase() = default;
 
+    const std::string &uniqueId() const
+    {
+        return _uniqueId;
+    }
+
+    // The server moved to a new address, route every following request there.
+    void setServerAddress(const std::string &ipAddress, uint16_t port);
+
+    // The device is gone from the network. Stops polling, drops responses still in flight and removes it
+    // from clients, the caller deletes it afterwards.
+    virtual void retire();
+
 protected:
     virtual bool initAlpacaBaseProperties();
 
+    // Handles the switches of AlpacaBase, call from ISNewSwitch before the device's own.
+    bool processAlpacaBaseSwitch(const char *dev, const char *name, ISState *states, char *names[], int n);
+
 protected:
     std::string _serverName;
     std::string _manufacturer;
@@ -57,20 +88,169 @@ protected:
     std::string _ipAddress;
     uint16_t _port;
 
+    // http://host:port/api/v1/{device_type}/{device_number}, built once per device and on server moves.
+    std::string _deviceUrl;
+
+    int _pollTimerId = -1;
+    AlpacaPollScheduler _pollScheduler;
+    AlpacaChangeFilter _published;
+
+    typedef std::function<void(AlpacaEnvelope &response)> ResponseCallback;
+
 private:
     uint32_t _clientId;
-    uint32_t _clientTransactionId;
     DefaultDevice *_device;
+    std::shared_ptr<AlpacaTransport> _transport;
+
+    // Expires with the device so that late responses are dropped instead of touching freed memory.
+    std::shared_ptr<bool> _lifetime;
+
+    // Writes base, path and the client query string into the request buffer without allocating, and takes
+    // the next transaction id for it.
+    void buildGetRequest(AlpacaRequest &request, const std::string &base, const char *path);
+
+    AlpacaEnvelope performGet(const std::string &base, const char *path);
+    AlpacaEnvelope performPut(const std::string &base, const char *path, AlpacaForm &body,
+                              AlpacaRequest::Priority priority);
+    void submitGet(const std::string &base, const char *path, ResponseCallback callback);
 
+    // Per endpoint request statistics, published on the Info tab.
+    AlpacaEndpointStats *endpointStats(AlpacaRequest::Method method, const char *path);
+    void recordEndpoint(AlpacaEndpointStats *stats, const AlpacaResponse &response);
+
+    std::vector<std::unique_ptr<AlpacaEndpointStats>> _endpointStats;
+    std::chrono::steady_clock::time_point _statsPublished;
+
+    // Writes the request trace of the driver to ~/.indi/alpaca_trace_<time>.log.
+    void dumpTrace();
+
+    // Responses of the static endpoints, read once per connection.
+    struct StaticResponse
+    {
+        std::string path;
+        AlpacaEnvelope response;
+    };
+    std::vector<StaticResponse> _staticResponses;
+
+    AlpacaEnvelope *staticResponse(const char *path);
+    AlpacaEnvelope *storeStaticResponse(const char *path, const AlpacaEnvelope &response);
+
+    std::vector<AlpacaEnvelope> storeStaticResponses(const std::vector<const char *> &urls,
+            const std::vector<AlpacaEnvelope> &responses, size_t staticCount);
+
+    // Fills the Info tab from the cached description, driver info, driver version, interface version and name.
+    void updateStaticProperties();
 
 protected:
-    nlohmann::json doGetRequest(const std::string url);
-    nlohmann::json doPutRequest(const std::string url, std::map<std::string, std::string> &body);
+    // Device requests only decode the Alpaca envelope, see AlpacaEnvelope.
+    AlpacaEnvelope doGetRequest(const char *url);
+    // PUTs are commands unless given ABORT, which is reserved for halting motion.
+    AlpacaEnvelope doPutRequest(const char *url, AlpacaForm &body,
+                                AlpacaRequest::Priority priority = AlpacaRequest::COMMAND);
+
+    AlpacaEnvelope doDeviceGetRequest(const char *url);
+    AlpacaEnvelope doDevicePutRequest(const char *url, AlpacaForm &body,
+                                      AlpacaRequest::Priority priority = AlpacaRequest::COMMAND);
+
+    // Non-blocking variants, the callback runs on the INDI thread unless the device is gone by then.
+    void doGetRequestAsync(const char *url, ResponseCallback callback);
+    void doDeviceGetRequestAsync(const char *url, ResponseCallback callback);
+
+    // Sends every GET at once, callback gets the responses in the order of urls after the last one resolves.
+    typedef std::function<void(std::vector<AlpacaEnvelope> &responses)> BatchCallback;
+    void doDeviceGetBatchAsync(const std::vector<const char *> &urls, BatchCallback callback);
+
+    // Blocking variant, the GETs still run concurrently. Returns the responses in the order of urls.
+    std::vector<AlpacaEnvelope> doDeviceGetBatch(const std::vector<const char *> &urls);
+
+    // Call from Connect. Drops what the previous connection cached and reads the common static endpoints,
+    // deviceStatic and probes in one concurrent burst. The static responses are kept until the next
+    // connect, the probe responses are returned in the order of probes.
+    std::vector<AlpacaEnvelope> loadStaticProperties(const std::vector<const char *> &deviceStatic,
+            const std::vector<const char *> &probes);
+
+    // Same without blocking, for revalidating a restored profile. callback gets the probe responses.
+    void loadStaticPropertiesAsync(const std::vector<const char *> &deviceStatic,
+                                   const std::vector<const char *> &probes, BatchCallback callback);
 
-    nlohmann::json doDeviceGetRequest(const std::string url);
-    nlohmann::json doDevicePutRequest(const std::string url, std::map<std::string, std::string> &body);
+    // The profile keeps the static responses and the capabilities of the device as of its last connect,
+    // keyed by UniqueID in ~/.indi/ALPACA_PROFILE_FILE. restoreProfile fills the static cache and the
+    // Info tab from it and returns the capabilities, null when the device has no profile yet.
+    nlohmann::json restoreProfile();
+    void saveProfile(const nlohmann::json &capabilities);
 
-    bool hasError(nlohmann::json &response);
+    bool hasError(AlpacaEnvelope &response);
+
+    // Typed access to the endpoints declared in endpoints.h, the value is decoded straight from the envelope.
+    template <typename Endpoint>
+    Alpaca::Value<typename Endpoint::value_type> get()
+    {
+        static_assert(Endpoint::verb == Alpaca::HTTP_GET, "get() needs a GET endpoint");
+
+        AlpacaEnvelope response = doDeviceGetRequest(Endpoint::path());
+
+        return decode<Endpoint>(response);
+    }
+
+    template <typename Endpoint>
+    Alpaca::Value<typename Endpoint::value_type> decode(AlpacaEnvelope &response)
+    {
+        typedef typename Endpoint::value_type T;
+
+        Alpaca::Value<T> result;
+        result.ok = !hasError(response);
+        result.errorNumber = response.errorNumber;
+        result.value = result.ok ? Alpaca::ValueDecoder<T>::decode(response) : T();
+
+        return result;
+    }
+
+    // A static endpoint from the cache, read on the first call when loadStaticProperties did not.
+    template <typename Endpoint>
+    Alpaca::Value<typename Endpoint::value_type> cached()
+    {
+        static_assert(Endpoint::isStatic, "cached() needs a static endpoint");
+
+        AlpacaEnvelope *response = staticResponse(Endpoint::path());
+
+        if (response == nullptr)
+            response = storeStaticResponse(Endpoint::path(), doDeviceGetRequest(Endpoint::path()));
+
+        return decode<Endpoint>(*response);
+    }
+
+    template <typename Endpoint>
+    bool put(AlpacaForm &body, AlpacaRequest::Priority priority = AlpacaRequest::COMMAND)
+    {
+        static_assert(Endpoint::verb == Alpaca::HTTP_PUT, "put() needs a PUT endpoint");
+
+        AlpacaEnvelope response = doDevicePutRequest(Endpoint::path(), body, priority);
+
+        return !hasError(response);
+    }
+
+    template <typename Endpoint>
+    bool put(AlpacaRequest::Priority priority = AlpacaRequest::COMMAND)
+    {
+        AlpacaForm body;
+
+        return put<Endpoint>(body, priority);
+    }
+
+    // Arms the poll timer for the interval the scheduler asks for, replacing a timer already armed.
+    void schedulePoll();
+
+    // Call after sending a command so its effect is seen at the next fast poll.
+    void kickPoll();
+
+    // Send a polled property only when it differs from what was last sent, numbers beyond tolerance.
+    void publishSwitch(ISwitchVectorProperty *svp);
+    void publishNumber(INumberVectorProperty *nvp, double tolerance);
+
+    void logTransportStats();
+
+    // Sends the endpoint statistics that changed, at most every ALPACA_STATS_PUBLISH_INTERVAL unless forced.
+    void publishEndpointStats(bool force);
 
     bool putConnected(const bool connected);
     bool getConnected();
@@ -139,6 +319,14 @@ protected:
     };
     INDI::PropertyText nameTP{Name::NAME_LEN};
 
+    // Dumps the in-memory request trace to a file, see AlpacaTrace.
+    enum Trace
+    {
+        TRACE_DUMP,
+        TRACE_LEN,
+    };
+    INDI::PropertySwitch traceSP{Trace::TRACE_LEN};
+
 }; // class AlpacaBase
 
 }; // namespace INDI
@@ -0,0 +1,63 @@
+#include "changefilter.h"
+
+#include <cmath>
+
+bool AlpacaChangeFilter::changed(const ISwitchVectorProperty *svp)
+{
+    auto it = _snapshots.find(svp->name);
+
+    if (it != _snapshots.end() && it->second.state == svp->s && it->second.values.size() == size_t(svp->nsp))
+    {
+        bool same = true;
+
+        for (int i = 0; i < svp->nsp && same; i++)
+            same = it->second.values[i] == svp->sp[i].s;
+
+        if (same)
+            return false;
+    }
+
+    Snapshot &snapshot = _snapshots[svp->name];
+    snapshot.state = svp->s;
+    snapshot.values.resize(svp->nsp);
+
+    for (int i = 0; i < svp->nsp; i++)
+        snapshot.values[i] = svp->sp[i].s;
+
+    return true;
+}
+
+bool AlpacaChangeFilter::changed(const INumberVectorProperty *nvp, double tolerance)
+{
+    auto it = _snapshots.find(nvp->name);
+
+    if (it != _snapshots.end() && it->second.state == nvp->s && it->second.values.size() == size_t(nvp->nnp))
+    {
+        bool same = true;
+
+        for (int i = 0; i < nvp->nnp && same; i++)
+            same = std::fabs(it->second.values[i] - nvp->np[i].value) <= tolerance;
+
+        if (same)
+            return false;
+    }
+
+    Snapshot &snapshot = _snapshots[nvp->name];
+    snapshot.state = nvp->s;
+    snapshot.values.resize(nvp->nnp);
+
+    for (int i = 0; i < nvp->nnp; i++)
+        snapshot.values[i] = nvp->np[i].value;
+
+    return true;
+}
+
+void AlpacaChangeFilter::forget(const char *name)
+{
+    _snapshots.erase(name);
+}
+
+void AlpacaChangeFilter::reset()
+{
+    _snapshots.clear();
+}
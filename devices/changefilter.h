@@ -0,0 +1,41 @@
+#pragma once
+#ifndef CHANGEFILTER_H
+#define CHANGEFILTER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <libindi/indiapi.h>
+
+/**
+ * @brief Remembers what was last sent for each property, so polls only send the ones that changed.
+ *
+ * A property counts as changed when its state, a switch or a number beyond the tolerance differs from
+ * the last snapshot. Numbers are compared with the last value sent, so a slow drift is still published
+ * once it adds up.
+ */
+class AlpacaChangeFilter
+{
+public:
+    // True when svp differs from the last snapshot, which it then replaces.
+    bool changed(const ISwitchVectorProperty *svp);
+    bool changed(const INumberVectorProperty *nvp, double tolerance);
+
+    // Something else sent the property, e.g. a client command, compare the next poll with nothing.
+    void forget(const char *name);
+
+    // Send everything again, on connect.
+    void reset();
+
+private:
+    struct Snapshot
+    {
+        IPState state;
+        std::vector<double> values;
+    };
+
+    std::map<std::string, Snapshot> _snapshots;
+};
+
+#endif // CHANGEFILTER_H
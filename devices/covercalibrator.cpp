@@ -1,5 +1,6 @@
 #include "config.h"
 #include "covercalibrator.h"
+#include <cstring>
 
 using namespace INDI;
 
@@ -43,6 +44,9 @@ void AlpacaCoverCalibrator::ISGetProperties(const char *dev)
 
 bool AlpacaCoverCalibrator::ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n)
 {
+    // The handlers below send the property themselves.
+    _published.forget(name);
+
     if (processLightBoxNumber(dev, name, values, names, n))
     {
         return true;
@@ -53,6 +57,21 @@ bool AlpacaCoverCalibrator::ISNewNumber(const char *dev, const char *name, doubl
 
 bool AlpacaCoverCalibrator::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
 {
+    _published.forget(name);
+
+    if (processAlpacaBaseSwitch(dev, name, states, names, n))
+    {
+        return true;
+    }
+
+    if (dev != nullptr && strcmp(dev, getDeviceName()) == 0 && abortCapSP.isNameMatch(name))
+    {
+        abortCapSP.reset();
+        abortCapSP.setState(putHaltCover() ? IPS_OK : IPS_ALERT);
+        abortCapSP.apply();
+        return true;
+    }
+
     if (processLightBoxSwitch(dev, name, states, names, n))
     {
         return true;
@@ -92,6 +111,9 @@ bool AlpacaCoverCalibrator::initProperties()
     initLightBoxProperties(getDeviceName(), MAIN_CONTROL_TAB);
     initDustCapProperties(getDeviceName(), MAIN_CONTROL_TAB);
 
+    abortCapSP[AbortCap::ABORT_CAP].fill("ABORT", "Abort", ISS_OFF);
+    abortCapSP.fill(getDeviceName(), "CAP_ABORT", "Abort Cover", MAIN_CONTROL_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+
     addAuxControls();
 
     return true;
@@ -108,6 +130,7 @@ bool AlpacaCoverCalibrator::updateProperties()
         if (supportsDustCap())
         {
             defineProperty(&ParkCapSP);
+            defineProperty(abortCapSP);
             interface |= BaseDevice::DUSTCAP_INTERFACE;
         }
 
@@ -124,6 +147,7 @@ bool AlpacaCoverCalibrator::updateProperties()
     else
     {
         deleteProperty(ParkCapSP.name);
+        deleteProperty(abortCapSP.getName());
         deleteProperty(LightSP.name);
         deleteProperty(LightIntensityNP.name);
     }
@@ -140,13 +164,11 @@ bool AlpacaCoverCalibrator::saveConfigItems(FILE *fp)
     return true;
 }
 
-int AlpacaCoverCalibrator::getBrightness()
+int AlpacaCoverCalibrator::brightnessFromResponse(const Alpaca::Value<int> &response)
 {
-    nlohmann::json response = doDeviceGetRequest("/brightness");
-
-    if (hasError(response))
+    if (!response.ok)
     {
-        if (response["ErrorNumber"] == ALPACA_ERROR_NOT_IMPLEMENTED)
+        if (response.errorNumber == ALPACA_ERROR_NOT_IMPLEMENTED)
         {
             _supportsLightBox = false;
         }
@@ -154,20 +176,18 @@ int AlpacaCoverCalibrator::getBrightness()
         return -1;
     }
 
-    int brightness = response["Value"].get<int>();
+    int brightness = response.value;
 
     _supportsLightBox = true;
 
     return brightness;
 }
 
-AlpacaCoverCalibrator::AlpacaCalibratorStatus AlpacaCoverCalibrator::getCalibratorState()
+AlpacaCoverCalibrator::AlpacaCalibratorStatus AlpacaCoverCalibrator::calibratorStateFromResponse(const Alpaca::Value<int> &response)
 {
-    nlohmann::json response = doDeviceGetRequest("/calibratorstate");
-
-    if (hasError(response))
+    if (!response.ok)
     {
-        if (response["ErrorNumber"] == ALPACA_ERROR_NOT_IMPLEMENTED)
+        if (response.errorNumber == ALPACA_ERROR_NOT_IMPLEMENTED)
         {
             _supportsLightBox = false;
         }
@@ -175,7 +195,7 @@ AlpacaCoverCalibrator::AlpacaCalibratorStatus AlpacaCoverCalibrator::getCalibrat
         return Calibrator_Error;
     }
 
-    AlpacaCalibratorStatus status = static_cast<AlpacaCalibratorStatus>(response["Value"].get<int>());
+    AlpacaCalibratorStatus status = static_cast<AlpacaCalibratorStatus>(response.value);
 
     if (status == Calibrator_NotPresent)
     {
@@ -188,13 +208,11 @@ AlpacaCoverCalibrator::AlpacaCalibratorStatus AlpacaCoverCalibrator::getCalibrat
     return status;
 }
 
-AlpacaCoverCalibrator::AlpacaCoverStatus AlpacaCoverCalibrator::getCoverState()
+AlpacaCoverCalibrator::AlpacaCoverStatus AlpacaCoverCalibrator::coverStateFromResponse(const Alpaca::Value<int> &response)
 {
-    nlohmann::json response = doDeviceGetRequest("/coverstate");
-
-    if (hasError(response))
+    if (!response.ok)
     {
-        if (response["ErrorNumber"] == ALPACA_ERROR_NOT_IMPLEMENTED)
+        if (response.errorNumber == ALPACA_ERROR_NOT_IMPLEMENTED)
         {
             _supportsDustCap = false;
         }
@@ -202,7 +220,7 @@ AlpacaCoverCalibrator::AlpacaCoverStatus AlpacaCoverCalibrator::getCoverState()
         return Cover_Error;
     }
 
-    AlpacaCoverStatus status = static_cast<AlpacaCoverStatus>(response["Value"].get<int>());
+    AlpacaCoverStatus status = static_cast<AlpacaCoverStatus>(response.value);
 
     if (status == Cover_NotPresent)
     {
@@ -217,11 +235,11 @@ AlpacaCoverCalibrator::AlpacaCoverStatus AlpacaCoverCalibrator::getCoverState()
 
 int AlpacaCoverCalibrator::getMaxBrightness()
 {
-    nlohmann::json response = doDeviceGetRequest("/maxbrightness");
+    Alpaca::Value<int> response = cached<Alpaca::CoverCalibrator::MaxBrightness>();
 
-    if (hasError(response))
+    if (!response.ok)
     {
-        if (response["ErrorNumber"] == ALPACA_ERROR_NOT_IMPLEMENTED)
+        if (response.errorNumber == ALPACA_ERROR_NOT_IMPLEMENTED)
         {
             _supportsLightBox = false;
         }
@@ -229,7 +247,7 @@ int AlpacaCoverCalibrator::getMaxBrightness()
         return -1;
     }
 
-    int maxBrightness = response["Value"].get<int>();
+    int maxBrightness = response.value;
 
     _supportsLightBox = true;
 
@@ -241,12 +259,11 @@ bool AlpacaCoverCalibrator::putCalibratorOff()
     if (!_supportsLightBox)
         return false;
 
-    std::map<std::string, std::string> body;
-    auto response = doDevicePutRequest("/calibratoroff", body);
-
-    if (hasError(response))
+    if (!put<Alpaca::CoverCalibrator::CalibratorOff>())
         return false;
 
+    kickPoll();
+
     return true;
 }
 
@@ -255,15 +272,15 @@ bool AlpacaCoverCalibrator::putCalibratorOn()
     if (!_supportsLightBox)
         return false;
 
-    std::map<std::string, std::string> body;
+    AlpacaForm body;
 
-    body["Brightness"] = std::to_string(int32_t(LightIntensityN[0].value));
+    body.add("Brightness", int32_t(LightIntensityN[0].value));
 
-    auto response = doDevicePutRequest("/calibratoron", body);
-
-    if (hasError(response))
+    if (!put<Alpaca::CoverCalibrator::CalibratorOn>(body))
         return false;
 
+    kickPoll();
+
     return true;
 }
 
@@ -272,12 +289,11 @@ bool AlpacaCoverCalibrator::putCloseCover()
     if (!_supportsDustCap)
         return false;
 
-    std::map<std::string, std::string> body;
-    auto response = doDevicePutRequest("/closecover", body);
-
-    if (hasError(response))
+    if (!put<Alpaca::CoverCalibrator::CloseCover>())
         return false;
 
+    kickPoll();
+
     return true;
 }
 
@@ -286,12 +302,12 @@ bool AlpacaCoverCalibrator::putHaltCover()
     if (!_supportsDustCap)
         return false;
 
-    std::map<std::string, std::string> body;
-    auto response = doDevicePutRequest("/haltcover", body);
-
-    if (hasError(response))
+    // Must not wait behind the polls of other devices on the same server.
+    if (!put<Alpaca::CoverCalibrator::HaltCover>(AlpacaRequest::ABORT))
         return false;
 
+    kickPoll();
+
     return true;
 }
 
@@ -300,12 +316,11 @@ bool AlpacaCoverCalibrator::putOpenCover()
     if (!_supportsDustCap)
         return false;
 
-    std::map<std::string, std::string> body;
-    auto response = doDevicePutRequest("/opencover", body);
-
-    if (hasError(response))
+    if (!put<Alpaca::CoverCalibrator::OpenCover>())
         return false;
 
+    kickPoll();
+
     return true;
 }
 
@@ -313,96 +328,231 @@ bool AlpacaCoverCalibrator::Connect()
 {
     bool rc = putConnected(true);
 
-    if (rc)
-        SetTimer(POLLMS);
+    if (!rc)
+        return false;
 
-    return rc;
+    // Learn the capabilities from the state endpoints in the same burst as the static values.
+    std::vector<const char *> deviceStatic =
+    {
+        Alpaca::CoverCalibrator::MaxBrightness::path(),
+    };
+    std::vector<const char *> probes =
+    {
+        Alpaca::CoverCalibrator::CoverState::path(),
+        Alpaca::CoverCalibrator::CalibratorState::path(),
+    };
+
+    nlohmann::json capabilities = restoreProfile();
+
+    if (capabilities.is_object())
+    {
+        // Properties are defined from the profile right away, the probes catch up with a changed device.
+        _supportsDustCap = capabilities.value("DustCap", false);
+        _supportsLightBox = capabilities.value("LightBox", false);
+        updateMaxBrightness();
+
+        loadStaticPropertiesAsync(deviceStatic, probes, [this](std::vector<AlpacaEnvelope> &responses)
+        {
+            applyCapabilityProbes(responses, true);
+        });
+    }
+    else
+    {
+        std::vector<AlpacaEnvelope> responses = loadStaticProperties(deviceStatic, probes);
+        applyCapabilityProbes(responses, false);
+    }
+
+    _published.reset();
+    _pollScheduler.reset();
+    schedulePoll();
+
+    return true;
+}
+
+void AlpacaCoverCalibrator::applyCapabilityProbes(std::vector<AlpacaEnvelope> &responses, bool redefine)
+{
+    bool dustCap = _supportsDustCap;
+    bool lightBox = _supportsLightBox;
+
+    coverStateFromResponse(decode<Alpaca::CoverCalibrator::CoverState>(responses[0]));
+    calibratorStateFromResponse(decode<Alpaca::CoverCalibrator::CalibratorState>(responses[1]));
+
+    updateMaxBrightness();
+
+    // A probe that never reached the device says nothing about it, keep the last profile.
+    if (responses[0].ok && responses[1].ok)
+        saveProfile({{"DustCap", _supportsDustCap}, {"LightBox", _supportsLightBox}});
+
+    if (!redefine || !isConnected() || (dustCap == _supportsDustCap && lightBox == _supportsLightBox))
+        return;
+
+    DEBUGDEVICE(getDeviceName(), INDI::Logger::DBG_SESSION, "Capabilities differ from the saved profile, redefining properties.");
+
+    deleteProperty(ParkCapSP.name);
+    deleteProperty(abortCapSP.getName());
+    deleteProperty(LightSP.name);
+    deleteProperty(LightIntensityNP.name);
+
+    updateProperties();
+}
+
+void AlpacaCoverCalibrator::updateMaxBrightness()
+{
+    if (!_supportsLightBox)
+        return;
+
+    int maxBrightness = getMaxBrightness();
+
+    if (maxBrightness > 0)
+        LightIntensityN[0].max = maxBrightness;
 }
 
 bool AlpacaCoverCalibrator::Disconnect()
 {
-    return putConnected(false);
+    logTransportStats();
+
+    bool rc = putConnected(false);
+
+    // Flush what the throttle held back, the last polls included.
+    publishEndpointStats(true);
+
+    return rc;
 }
 
 void AlpacaCoverCalibrator::TimerHit()
 {
+    _pollTimerId = -1;
+
     if (!isConnected())
         return;
 
-    if (_supportsDustCap)
-    {
-        AlpacaCoverStatus status = getCoverState();
+    // Capabilities can change while the batch is in flight, decode with the set it was sent with.
+    bool dustCap = _supportsDustCap;
+    bool lightBox = _supportsLightBox;
 
-        switch (status)
-        {
-        case Cover_Closed:
-            ParkCapSP.s = IPS_IDLE;
-            IUResetSwitch(&ParkCapSP);
-            ParkCapS[CAP_PARK].s = ISS_ON;
-            break;
-
-        case Cover_Open:
-            ParkCapSP.s = IPS_IDLE;
-            IUResetSwitch(&ParkCapSP);
-            ParkCapS[CAP_UNPARK].s = ISS_ON;
-            break;
-
-        case Cover_Moving:
-            ParkCapSP.s = IPS_BUSY;
-            break;
-
-        default:
-            ParkCapSP.s = IPS_ALERT;
-            break;
-        }
+    std::vector<const char *> endpoints;
+
+    if (dustCap)
+        endpoints.push_back(Alpaca::CoverCalibrator::CoverState::path());
 
-        IDSetSwitch(&ParkCapSP, nullptr);
+    if (lightBox)
+    {
+        endpoints.push_back(Alpaca::CoverCalibrator::CalibratorState::path());
+        endpoints.push_back(Alpaca::CoverCalibrator::Brightness::path());
+    }
+
+    if (endpoints.empty())
+    {
+        _pollScheduler.update(false);
+        schedulePoll();
+        return;
     }
 
-    if (_supportsLightBox)
+    doDeviceGetBatchAsync(endpoints, [this, dustCap, lightBox](std::vector<AlpacaEnvelope> &responses)
     {
-        AlpacaCalibratorStatus status = getCalibratorState();
+        size_t i = 0;
+        bool busy = false;
+
+        if (dustCap)
+        {
+            AlpacaCoverStatus coverState = coverStateFromResponse(decode<Alpaca::CoverCalibrator::CoverState>(responses[i++]));
+            setCoverState(coverState);
+
+            busy |= coverState == Cover_Moving;
+        }
 
-        switch (status)
+        if (lightBox)
         {
-        case Calibrator_Off:
-            LightSP.s = IPS_IDLE;
-            IUResetSwitch(&LightSP);
-            LightS[FLAT_LIGHT_OFF].s = ISS_ON;
-            break;
-
-        case Calibrator_NotReady:
-            LightSP.s = IPS_BUSY;
-            IUResetSwitch(&LightSP);
-            LightS[FLAT_LIGHT_ON].s = ISS_ON;
-            break;
-
-        case Calibrator_Ready:
-            LightSP.s = IPS_OK;
-            IUResetSwitch(&LightSP);
-            LightS[FLAT_LIGHT_ON].s = ISS_ON;
-            break;
-
-        default:
-            LightSP.s = IPS_ALERT;
-            break;
+            AlpacaCalibratorStatus calibratorState = calibratorStateFromResponse(
+                        decode<Alpaca::CoverCalibrator::CalibratorState>(responses[i++]));
+            setCalibratorState(calibratorState);
+            setBrightness(brightnessFromResponse(decode<Alpaca::CoverCalibrator::Brightness>(responses[i++])));
+
+            busy |= calibratorState == Calibrator_NotReady;
         }
 
-        IDSetSwitch(&LightSP, nullptr);
+        _pollScheduler.update(busy);
+
+        if (isConnected())
+            schedulePoll();
+    });
+}
+
+void AlpacaCoverCalibrator::setCoverState(AlpacaCoverStatus status)
+{
+    switch (status)
+    {
+    case Cover_Closed:
+        ParkCapSP.s = IPS_IDLE;
+        IUResetSwitch(&ParkCapSP);
+        ParkCapS[CAP_PARK].s = ISS_ON;
+        break;
+
+    case Cover_Open:
+        ParkCapSP.s = IPS_IDLE;
+        IUResetSwitch(&ParkCapSP);
+        ParkCapS[CAP_UNPARK].s = ISS_ON;
+        break;
+
+    case Cover_Moving:
+        ParkCapSP.s = IPS_BUSY;
+        break;
+
+    default:
+        ParkCapSP.s = IPS_ALERT;
+        break;
     }
 
-    if (_supportsLightBox)
+    publishSwitch(&ParkCapSP);
+}
+
+void AlpacaCoverCalibrator::setCalibratorState(AlpacaCalibratorStatus status)
+{
+    switch (status)
     {
-        int brightness = getBrightness();
+    case Calibrator_Off:
+        LightSP.s = IPS_IDLE;
+        IUResetSwitch(&LightSP);
+        LightS[FLAT_LIGHT_OFF].s = ISS_ON;
+        break;
+
+    case Calibrator_NotReady:
+        LightSP.s = IPS_BUSY;
+        IUResetSwitch(&LightSP);
+        LightS[FLAT_LIGHT_ON].s = ISS_ON;
+        break;
+
+    case Calibrator_Ready:
+        LightSP.s = IPS_OK;
+        IUResetSwitch(&LightSP);
+        LightS[FLAT_LIGHT_ON].s = ISS_ON;
+        break;
+
+    default:
+        LightSP.s = IPS_ALERT;
+        break;
+    }
 
-        if (LightS[FLAT_LIGHT_ON].s == ISS_ON)
-        {
-            LightIntensityN[0].value = brightness;
-            IDSetNumber(&LightIntensityNP, nullptr);
-        }
+    publishSwitch(&LightSP);
+}
+
+void AlpacaCoverCalibrator::setBrightness(int brightness)
+{
+    if (LightS[FLAT_LIGHT_ON].s == ISS_ON)
+    {
+        LightIntensityN[0].value = brightness;
+        publishNumber(&LightIntensityNP, 0);
     }
+}
+
+void AlpacaCoverCalibrator::retire()
+{
+    if (_pollTimerId != -1)
+        RemoveTimer(_pollTimerId);
+
+    _pollTimerId = -1;
 
-    SetTimer(POLLMS);
+    AlpacaBase::retire();
 }
 
 const char *AlpacaCoverCalibrator::getDefaultName()
@@ -412,13 +562,11 @@ const char *AlpacaCoverCalibrator::getDefaultName()
 
 bool AlpacaCoverCalibrator::supportsLightBox()
 {
-    getCalibratorState();
     return _supportsLightBox;
 }
 
 bool AlpacaCoverCalibrator::supportsDustCap()
 {
-    getCoverState();
     return _supportsDustCap;
 }
 
@@ -56,6 +56,8 @@ public:
     virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
     virtual bool ISSnoopDevice(XMLEle *root) override;
 
+    virtual void retire() override;
+
 protected:
     virtual bool Connect() override;
     virtual bool Disconnect() override;
@@ -75,11 +77,16 @@ protected:
 
 
 private:
-    int getBrightness();
-    AlpacaCalibratorStatus getCalibratorState();
-    AlpacaCoverStatus getCoverState();
     int getMaxBrightness();
 
+    int brightnessFromResponse(const Alpaca::Value<int> &response);
+    AlpacaCalibratorStatus calibratorStateFromResponse(const Alpaca::Value<int> &response);
+    AlpacaCoverStatus coverStateFromResponse(const Alpaca::Value<int> &response);
+
+    void setCoverState(AlpacaCoverStatus status);
+    void setCalibratorState(AlpacaCalibratorStatus status);
+    void setBrightness(int brightness);
+
     bool putCalibratorOff();
     bool putCalibratorOn();
     bool putCloseCover();
@@ -89,8 +96,22 @@ private:
     bool supportsLightBox();
     bool supportsDustCap();
 
-    bool _supportsLightBox;
-    bool _supportsDustCap;
+    // Sets the capabilities from the /coverstate and /calibratorstate probes of a connect, saves them in the
+    // profile and redefines the properties when a restored profile was wrong.
+    void applyCapabilityProbes(std::vector<AlpacaEnvelope> &responses, bool redefine);
+    void updateMaxBrightness();
+
+    // Probed at connect, polls turn them off when the device stops implementing an endpoint.
+    bool _supportsLightBox = false;
+    bool _supportsDustCap = false;
+
+    // /haltcover, the DustCap interface has no abort of its own.
+    enum AbortCap
+    {
+        ABORT_CAP,
+        ABORT_CAP_LEN,
+    };
+    INDI::PropertySwitch abortCapSP{AbortCap::ABORT_CAP_LEN};
 
 }; // class CoverCalibrator
 
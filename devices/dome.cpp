@@ -41,6 +41,26 @@ bool AlpacaDome::initProperties()
     return true;
 }
 
+bool AlpacaDome::ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    if (processAlpacaBaseSwitch(dev, name, states, names, n))
+    {
+        return true;
+    }
+
+    return INDI::Dome::ISNewSwitch(dev, name, states, names, n);
+}
+
+void AlpacaDome::retire()
+{
+    if (_pollTimerId != -1)
+        RemoveTimer(_pollTimerId);
+
+    _pollTimerId = -1;
+
+    AlpacaBase::retire();
+}
+
 const char *AlpacaDome::getDefaultName()
 {
     return _deviceName.c_str();
@@ -56,21 +76,45 @@ bool AlpacaDome::Connect()
     bool rc = putConnected(true);
 
     if (rc)
-        SetTimer(POLLMS);
+    {
+        // A restored profile fills the Info tab right away and is refreshed in the background.
+        if (restoreProfile().is_object())
+        {
+            loadStaticPropertiesAsync({}, {}, [this](std::vector<AlpacaEnvelope> &)
+            {
+                saveProfile(nlohmann::json::object());
+            });
+        }
+        else
+        {
+            loadStaticProperties({}, {});
+            saveProfile(nlohmann::json::object());
+        }
+
+        _pollTimerId = SetTimer(POLLMS);
+    }
 
     return rc;
 }
 
 bool AlpacaDome::Disconnect()
 {
-    return putConnected(false);
+    logTransportStats();
+
+    bool rc = putConnected(false);
+
+    // Flush what the throttle held back, the last polls included.
+    publishEndpointStats(true);
+
+    return rc;
 }
 
 void AlpacaDome::TimerHit()
 {
+    _pollTimerId = -1;
+
     if (!isConnected())
         return;
-
 }
 
 IPState AlpacaDome::Move(DomeDirection dir, DomeMotionCommand operation)
@@ -105,7 +149,11 @@ IPState AlpacaDome::ControlShutter(ShutterOperation operation)
 
 bool AlpacaDome::Abort()
 {
-    return false;
+    // Jumps ahead of every queued poll and command, see AlpacaRequest::ABORT.
+    if (!put<Alpaca::Dome::AbortSlew>(AlpacaRequest::ABORT))
+        return false;
+
+    return true;
 }
 
 bool AlpacaDome::SetCurrentPark()
@@ -26,9 +26,12 @@ public:
     virtual ~AlpacaDome() = default;
 
     virtual bool initProperties() override;
+    virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
     const char *getDefaultName() override;
     bool updateProperties() override;
 
+    virtual void retire() override;
+
 protected:
     bool Connect() override;
     bool Disconnect() override;
@@ -0,0 +1,129 @@
+#pragma once
+#ifndef ENDPOINTS_H
+#define ENDPOINTS_H
+
+#include <string>
+
+#include "envelope.h"
+
+namespace Alpaca
+{
+
+enum HttpVerb
+{
+    HTTP_GET,
+    HTTP_PUT,
+};
+
+/**
+ * @brief Decodes the Value of an envelope into the value type of an endpoint.
+ */
+template <typename T>
+struct ValueDecoder;
+
+template <>
+struct ValueDecoder<bool>
+{
+    static bool decode(const AlpacaEnvelope &response)
+    {
+        return response.asBool();
+    }
+};
+
+template <>
+struct ValueDecoder<int>
+{
+    static int decode(const AlpacaEnvelope &response)
+    {
+        return response.asInt();
+    }
+};
+
+template <>
+struct ValueDecoder<double>
+{
+    static double decode(const AlpacaEnvelope &response)
+    {
+        return response.asDouble();
+    }
+};
+
+template <>
+struct ValueDecoder<std::string>
+{
+    static std::string decode(const AlpacaEnvelope &response)
+    {
+        return response.asString();
+    }
+};
+
+// PUT endpoints carry no value.
+struct NoValue {};
+
+template <>
+struct ValueDecoder<NoValue>
+{
+    static NoValue decode(const AlpacaEnvelope &)
+    {
+        return NoValue();
+    }
+};
+
+/**
+ * @brief The typed result of an endpoint call.
+ */
+template <typename T>
+struct Value
+{
+    bool ok;
+    int errorNumber;
+    T value;
+};
+
+// Static endpoints return the same value for the whole session and only need to be read once.
+#define ALPACA_ENDPOINT(NAME, PATH, VERB, TYPE, STATIC) \
+    struct NAME \
+    { \
+        typedef TYPE value_type; \
+        static const char *path() { return PATH; } \
+        static const HttpVerb verb = VERB; \
+        static const bool isStatic = STATIC; \
+    }
+
+// /{device_type}/{device_number}/...
+namespace Common
+{
+ALPACA_ENDPOINT(Connected, "/connected", HTTP_GET, bool, false);
+ALPACA_ENDPOINT(SetConnected, "/connected", HTTP_PUT, NoValue, false);
+ALPACA_ENDPOINT(Description, "/description", HTTP_GET, std::string, true);
+ALPACA_ENDPOINT(DriverInfo, "/driverinfo", HTTP_GET, std::string, true);
+ALPACA_ENDPOINT(DriverVersion, "/driverversion", HTTP_GET, std::string, true);
+ALPACA_ENDPOINT(InterfaceVersion, "/interfaceversion", HTTP_GET, int, true);
+ALPACA_ENDPOINT(Name, "/name", HTTP_GET, std::string, true);
+}
+
+// /covercalibrator/{device_number}/...
+namespace CoverCalibrator
+{
+ALPACA_ENDPOINT(Brightness, "/brightness", HTTP_GET, int, false);
+ALPACA_ENDPOINT(CalibratorState, "/calibratorstate", HTTP_GET, int, false);
+ALPACA_ENDPOINT(CoverState, "/coverstate", HTTP_GET, int, false);
+ALPACA_ENDPOINT(MaxBrightness, "/maxbrightness", HTTP_GET, int, true);
+ALPACA_ENDPOINT(CalibratorOff, "/calibratoroff", HTTP_PUT, NoValue, false);
+ALPACA_ENDPOINT(CalibratorOn, "/calibratoron", HTTP_PUT, NoValue, false);
+ALPACA_ENDPOINT(CloseCover, "/closecover", HTTP_PUT, NoValue, false);
+ALPACA_ENDPOINT(HaltCover, "/haltcover", HTTP_PUT, NoValue, false);
+ALPACA_ENDPOINT(OpenCover, "/opencover", HTTP_PUT, NoValue, false);
+}
+
+// /dome/{device_number}/...
+namespace Dome
+{
+ALPACA_ENDPOINT(AbortSlew, "/abortslew", HTTP_PUT, NoValue, false);
+}
+
+#undef ALPACA_ENDPOINT
+
+} // namespace Alpaca
+
+#endif // ENDPOINTS_H
@@ -0,0 +1,110 @@
+#include "endpointstats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include <libindi/defaultdevice.h>
+
+void LatencyHistogram::add(int64_t us)
+{
+    _buckets[bucket(us)]++;
+    _count++;
+
+    if (us > _max)
+        _max = us;
+}
+
+int64_t LatencyHistogram::percentile(double p) const
+{
+    if (_count == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p * _count));
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += _buckets[i];
+
+        // The bucket bound can overshoot the largest sample, never report more than was measured. The last
+        // bucket is open ended.
+        if (seen >= rank)
+            return i == LATENCY_BUCKETS - 1 ? _max : std::min(upperBound(i), _max);
+    }
+
+    return _max;
+}
+
+int LatencyHistogram::bucket(int64_t us)
+{
+    if (us <= LATENCY_FIRST_BUCKET_US)
+        return 0;
+
+    int index = static_cast<int>(std::ceil(4 * std::log2(double(us) / LATENCY_FIRST_BUCKET_US)));
+
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+int64_t LatencyHistogram::upperBound(int bucket)
+{
+    return static_cast<int64_t>(LATENCY_FIRST_BUCKET_US * std::pow(2.0, bucket / 4.0));
+}
+
+AlpacaEndpointStats::AlpacaEndpointStats(const char *deviceName, AlpacaRequest::Method method, const char *path)
+    : method(method), path(path)
+{
+    const char *verb = method == AlpacaRequest::PUT ? "PUT" : "GET";
+
+    // STATS_GET_COVERSTATE for GET /coverstate.
+    std::string name = std::string("STATS_") + verb + "_";
+    for (const char *c = path; *c != 0; c++)
+    {
+        if (isalnum(static_cast<unsigned char>(*c)))
+            name += static_cast<char>(toupper(static_cast<unsigned char>(*c)));
+        else if (c != path)
+            name += '_';
+    }
+
+    std::string label = std::string(verb) + " " + path;
+
+    property[REQUESTS].fill("REQUESTS", "Requests", "%.0f", 0, 0, 0, 0);
+    property[ERRORS].fill("ERRORS", "Errors", "%.0f", 0, 0, 0, 0);
+    property[BYTES].fill("BYTES", "Bytes", "%.0f", 0, 0, 0, 0);
+    property[P50].fill("P50", "p50 (ms)", "%.2f", 0, 0, 0, 0);
+    property[P95].fill("P95", "p95 (ms)", "%.2f", 0, 0, 0, 0);
+    property[P99].fill("P99", "p99 (ms)", "%.2f", 0, 0, 0, 0);
+    property[MAX].fill("MAX", "Max (ms)", "%.2f", 0, 0, 0, 0);
+    property.fill(deviceName, name.c_str(), label.c_str(), INFO_TAB, IP_RO, 60, IPS_IDLE);
+}
+
+void AlpacaEndpointStats::record(const AlpacaResponse &response)
+{
+    requests++;
+    bytes += response.bytes;
+
+    if (!response.envelope.ok || response.envelope.errorNumber != 0)
+        errors++;
+
+    // As the device sees it, waiting for a connection slot included.
+    latency.add(response.timing.queued + response.timing.total);
+
+    dirty = true;
+}
+
+void AlpacaEndpointStats::update()
+{
+    property[REQUESTS].setValue(requests);
+    property[ERRORS].setValue(errors);
+    property[BYTES].setValue(bytes);
+    property[P50].setValue(latency.percentile(0.50) / 1000.0);
+    property[P95].setValue(latency.percentile(0.95) / 1000.0);
+    property[P99].setValue(latency.percentile(0.99) / 1000.0);
+    property[MAX].setValue(latency.max() / 1000.0);
+    property.setState(IPS_OK);
+
+    dirty = false;
+}
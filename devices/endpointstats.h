@@ -0,0 +1,86 @@
+#pragma once
+#ifndef ENDPOINTSTATS_H
+#define ENDPOINTSTATS_H
+
+#include <cstdint>
+#include <string>
+
+#include <libindi/indipropertynumber.h>
+
+#include "requestengine.h"
+
+#define LATENCY_BUCKETS 64
+#define LATENCY_FIRST_BUCKET_US 100 // Buckets grow by 2^(1/4) from here, the last one ends around 6.5 s
+
+/**
+ * @brief Log scaled latency histogram, percentiles are accurate to one bucket (about 19%).
+ */
+class LatencyHistogram
+{
+public:
+    void add(int64_t us);
+
+    // Upper bound of the bucket holding the p-th percentile (0 to 1), in microseconds. 0 when empty.
+    int64_t percentile(double p) const;
+
+    uint64_t count() const
+    {
+        return _count;
+    }
+    int64_t max() const
+    {
+        return _max;
+    }
+
+private:
+    static int bucket(int64_t us);
+    static int64_t upperBound(int bucket);
+
+private:
+    uint64_t _buckets[LATENCY_BUCKETS] = {};
+    uint64_t _count = 0;
+    int64_t _max = 0;
+};
+
+/**
+ * @brief Request statistics of one endpoint of a device, published as a read-only number property.
+ */
+struct AlpacaEndpointStats
+{
+    enum Stat
+    {
+        REQUESTS,
+        ERRORS,
+        BYTES,
+        P50,
+        P95,
+        P99,
+        MAX,
+        STATS_LEN,
+    };
+
+    AlpacaEndpointStats(const char *deviceName, AlpacaRequest::Method method, const char *path);
+
+    void record(const AlpacaResponse &response);
+
+    // Copies the counters into the property, the caller defines or applies it.
+    void update();
+
+    AlpacaRequest::Method method;
+    std::string path;
+
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    LatencyHistogram latency;
+
+    // Changed since the property was last sent.
+    bool dirty = false;
+
+    // The property was sent to clients with defineProperty, later updates only apply it.
+    bool defined = false;
+
+    INDI::PropertyNumber property{STATS_LEN};
+};
+
+#endif // ENDPOINTSTATS_H
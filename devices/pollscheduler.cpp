@@ -0,0 +1,49 @@
+#include "pollscheduler.h"
+
+#include <algorithm>
+
+// 2^5 times the polling period is past any heartbeat, there is no point counting further.
+#define MAX_IDLE_POLLS 5
+
+void AlpacaPollScheduler::reset()
+{
+    _idlePolls = 0;
+    _kicked = std::chrono::steady_clock::time_point();
+}
+
+void AlpacaPollScheduler::kick()
+{
+    _idlePolls = 0;
+    _kicked = std::chrono::steady_clock::now();
+}
+
+void AlpacaPollScheduler::update(bool busy)
+{
+    if (busy)
+    {
+        _idlePolls = 0;
+        return;
+    }
+
+    // Idle right after a command usually means the device has not started yet.
+    if (kicked())
+        return;
+
+    if (_idlePolls < MAX_IDLE_POLLS)
+        _idlePolls++;
+}
+
+uint32_t AlpacaPollScheduler::interval(uint32_t fastMs) const
+{
+    if (_idlePolls == 0 || kicked())
+        return fastMs;
+
+    uint32_t idleMs = std::max<uint32_t>(fastMs, ALPACA_POLL_IDLE_MS);
+
+    return std::min<uint32_t>(fastMs << _idlePolls, idleMs);
+}
+
+bool AlpacaPollScheduler::kicked() const
+{
+    return std::chrono::steady_clock::now() - _kicked < std::chrono::milliseconds(ALPACA_POLL_KICK_MS);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+
+#define ALPACA_POLL_IDLE_MS 5000 // Heartbeat of a device where nothing is changing
+#define ALPACA_POLL_KICK_MS 3000 // Polls stay fast this long after a command, the device may not report busy yet
+
+/**
+ * @brief Picks the interval of the next poll of a device from what the last polls reported.
+ *
+ * Polls at the device polling period while something is moving or settling and for a moment after
+ * every command, then doubles the interval with each idle poll up to the ALPACA_POLL_IDLE_MS heartbeat.
+ */
+class AlpacaPollScheduler
+{
+public:
+    // Poll fast again, on connect.
+    void reset();
+
+    // A command was sent to the device.
+    void kick();
+
+    // Outcome of a poll, busy while anything on the device is changing.
+    void update(bool busy);
+
+    // Milliseconds until the next poll, fastMs is the polling period of the device.
+    uint32_t interval(uint32_t fastMs) const;
+
+private:
+    bool kicked() const;
+
+private:
+    uint32_t _idlePolls = 0;
+    std::chrono::steady_clock::time_point _kicked;
+};
+
+#endif // POLLSCHEDULER_H
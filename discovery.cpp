@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #if defined(_WIN32) || defined(__USE_W32_SOCKETS)
 #include <winsock2.h>
@@ -18,6 +26,10 @@
 #endif
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
 #endif
 
 #include <libindi/indicom.h>
@@ -25,138 +37,703 @@
 #include <libindi/json.h>
 
 #include "discovery.h"
+#include "storage.h"
 
 #define ALPACA_DISCOVERY_PORT 32227
-#define RECEIVE_BUFFER_SIZE 64
+#define ALPACA_DISCOVERY_MULTICAST_IPV6 "ff12::a1:9aca"
+#define RECEIVE_BUFFER_SIZE 65536 // Largest UDP datagram
 #define ALPACA_DISCOVERY_TIMEOUT 1 // Seconds
+#define ALPACA_DISCOVERY_WORKERS 4
+#define ALPACA_SERVERS_ENV "ALPACA_SERVERS" // host:port list that replaces the broadcast
+#define ALPACA_DISCOVERY_CACHE_FILE "alpaca_discovery.json"
+#define ALPACA_DISCOVERY_CACHE_MAX_MISSES 3 // Discoveries a cached device may be unreachable before eviction
+#define ALPACA_DISCOVERY_INTERVAL_ENV "ALPACA_DISCOVERY_INTERVAL" // Seconds between discoveries, 0 for startup only
+#define ALPACA_DISCOVERY_INTERVAL 60 // Seconds
 
 using namespace INDI;
 
+struct DiscoveredDevice
+{
+    std::string serverName;
+    std::string manufacturer;
+    std::string manufacturerVersion;
+    std::string location;
+    std::string deviceName;
+    std::string deviceType;
+    uint32_t deviceNumber;
+    std::string uniqueId;
+    std::string ipAddress;
+    uint16_t port;
+
+    nlohmann::json toJson() const
+    {
+        return nlohmann::json
+        {
+            {"ServerName", serverName},
+            {"Manufacturer", manufacturer},
+            {"ManufacturerVersion", manufacturerVersion},
+            {"Location", location},
+            {"DeviceName", deviceName},
+            {"DeviceType", deviceType},
+            {"DeviceNumber", deviceNumber},
+            {"UniqueID", uniqueId},
+            {"IPAddress", ipAddress},
+            {"Port", port},
+        };
+    }
+
+    static DiscoveredDevice fromJson(const nlohmann::json &doc)
+    {
+        DiscoveredDevice found;
+        found.serverName = doc.value("ServerName", "");
+        found.manufacturer = doc.value("Manufacturer", "");
+        found.manufacturerVersion = doc.value("ManufacturerVersion", "");
+        found.location = doc.value("Location", "");
+        found.deviceName = doc.value("DeviceName", "");
+        found.deviceType = doc.value("DeviceType", "");
+        found.deviceNumber = doc.value("DeviceNumber", 0);
+        found.uniqueId = doc.value("UniqueID", "");
+        found.ipAddress = doc.value("IPAddress", "");
+        found.port = doc.value("Port", 0);
+        return found;
+    }
+
+    std::string serverKey() const
+    {
+        return ipAddress + ":" + std::to_string(port);
+    }
+};
+
+// What one discovery run heard back, filled from the worker threads.
+struct DiscoveryResult
+{
+    std::mutex mutex;
+    std::set<std::string> servers;
+    std::set<std::string> uniqueIds;
+};
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Runs the management queries of several servers at once on a bounded number of threads.
+ */
+class DiscoveryPool
+{
+public:
+    explicit DiscoveryPool(size_t maxWorkers) : _maxWorkers(maxWorkers), _closing(false), _idle(0) {}
+
+    ~DiscoveryPool()
+    {
+        wait();
+    }
+
+    void add(std::function<void()> job)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _jobs.push_back(std::move(job));
+
+        if (_idle == 0 && _workers.size() < _maxWorkers)
+            _workers.push_back(std::thread(&DiscoveryPool::run, this));
+        else
+            _condition.notify_one();
+    }
+
+    // Finish every queued job and stop the workers.
+    void wait()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closing = true;
+        }
+
+        _condition.notify_all();
+
+        for (auto &worker : _workers)
+            worker.join();
+
+        _workers.clear();
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (true)
+        {
+            if (_jobs.empty())
+            {
+                if (_closing)
+                    return;
+
+                _idle++;
+                _condition.wait(lock);
+                _idle--;
+                continue;
+            }
+
+            std::function<void()> job = std::move(_jobs.front());
+            _jobs.pop_front();
+
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+private:
+    size_t _maxWorkers;
+    bool _closing;
+    size_t _idle;
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::function<void()>> _jobs;
+    std::vector<std::thread> _workers;
+};
+
 static class Loader
 {
     std::deque<std::unique_ptr<AlpacaBase>> devices;
+    std::thread discoveryThread;
+
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopping = false;
+
+    // Only touched on the INDI thread once discovery is running.
+    std::string cachePath;
+    nlohmann::json cache;
 public:
     Loader()
     {
         IDLog("Loading Alpaca Devices driver\n");
-        discover();
+        AlpacaDispatcher::init();
+
+        restoreCache();
+
+        // Discovery waits on the network, run it in the background so the driver answers clients right away.
+        discoveryThread = std::thread(&Loader::run, this);
+    }
+
+    ~Loader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopping = true;
+        }
+
+        stopCondition.notify_all();
+
+        if (discoveryThread.joinable())
+            discoveryThread.join();
+    }
+
+    // Keeps discovering so devices plugged in later show up and vanished ones are retired.
+    void run()
+    {
+        int interval = ALPACA_DISCOVERY_INTERVAL;
+
+        const char *setting = getenv(ALPACA_DISCOVERY_INTERVAL_ENV);
+        if (setting != nullptr)
+            interval = atoi(setting);
+
+        while (true)
+        {
+            discover();
+
+            std::unique_lock<std::mutex> lock(stopMutex);
+
+            if (interval <= 0)
+                return;
+
+            stopCondition.wait_for(lock, std::chrono::seconds(interval), [this]()
+            {
+                return stopping;
+            });
+
+            if (stopping)
+                return;
+        }
+    }
+
+    void restoreCache()
+    {
+        cachePath = alpacaStoragePath(ALPACA_DISCOVERY_CACHE_FILE);
+        cache = loadJsonFile(cachePath);
+
+        if (!cache.is_object() || !cache.contains("devices") || !cache["devices"].is_object())
+            cache = nlohmann::json{{"devices", nlohmann::json::object()}};
+
+        IDLog("Restoring %d devices from the discovery cache\n", (int)cache["devices"].size());
+
+        // Known devices come up immediately, discovery revalidates them in the background.
+        for (auto &entry : cache["devices"])
+        {
+            DiscoveredDevice found = DiscoveredDevice::fromJson(entry);
+
+            AlpacaDispatcher::post([this, found]()
+            {
+                addDevice(found, true);
+            });
+        }
     }
 
     void discover()
     {
-        IDLog("Sending discovery packet\n");
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        std::shared_ptr<DiscoveryResult> result = std::make_shared<DiscoveryResult>();
+        DiscoveryPool pool(ALPACA_DISCOVERY_WORKERS);
 
-        int s;
+        std::vector<std::pair<std::string, uint16_t>> servers = staticServers();
 
-        s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (s == -1)
+        if (servers.empty())
         {
-            IDLog("Error creating socket\n");
-            return;
+            broadcast(pool, result, started);
+        }
+        else
+        {
+            // Servers on routed subnets never see the broadcast, query the configured list directly.
+            IDLog("Using %d servers from %s\n", (int)servers.size(), ALPACA_SERVERS_ENV);
+
+            for (auto &server : servers)
+                queueServer(pool, result, server.first, server.second, 0);
         }
 
-        int broadcast=1;
-        setsockopt(s, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+        pool.wait();
+
+        IDLog("discovery complete in %.0f ms\n", millisecondsSince(started));
+
+        AlpacaDispatcher::post([this, result]()
+        {
+            reconcile(*result);
+        });
+    }
+
+    // Parses ALPACA_SERVERS, a comma separated list of host:port or [ipv6]:port endpoints.
+    std::vector<std::pair<std::string, uint16_t>> staticServers()
+    {
+        std::vector<std::pair<std::string, uint16_t>> servers;
 
-        struct timeval tv;
-        tv.tv_sec = ALPACA_DISCOVERY_TIMEOUT;
-        tv.tv_usec = 0;
-        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO,&tv,sizeof(tv));
+        const char *list = getenv(ALPACA_SERVERS_ENV);
+        if (list == nullptr)
+            return servers;
 
-        struct sockaddr_in Recv_addr;
+        std::string remaining = list;
 
-        socklen_t len = sizeof(struct sockaddr_in);
+        while (!remaining.empty())
+        {
+            size_t comma = remaining.find(',');
+            std::string endpoint = remaining.substr(0, comma);
+            remaining = comma == std::string::npos ? "" : remaining.substr(comma + 1);
 
-        char recvbuff[RECEIVE_BUFFER_SIZE];
+            endpoint.erase(0, endpoint.find_first_not_of(" \t"));
+            endpoint.erase(endpoint.find_last_not_of(" \t") + 1);
 
-        Recv_addr.sin_family       = AF_INET;
-        Recv_addr.sin_port         = htons(ALPACA_DISCOVERY_PORT);
-        Recv_addr.sin_addr.s_addr  = INADDR_BROADCAST;
+            size_t colon = endpoint.rfind(':');
+            if (endpoint.empty() || colon == std::string::npos || colon == 0)
+            {
+                if (!endpoint.empty())
+                    IDLog("Ignoring %s endpoint without a port: %s\n", ALPACA_SERVERS_ENV, endpoint.c_str());
+                continue;
+            }
 
-        char sendMSG[17] = "alpacadiscovery1";
+            std::string host = endpoint.substr(0, colon);
+            int port = atoi(endpoint.c_str() + colon + 1);
 
-        sendto(s, sendMSG, strlen(sendMSG), 0, (sockaddr *)&Recv_addr, sizeof(Recv_addr));
+            if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+                host = host.substr(1, host.size() - 2);
 
-        while (true)
+            if (port <= 0 || port > 65535)
+            {
+                IDLog("Ignoring %s endpoint with an invalid port: %s\n", ALPACA_SERVERS_ENV, endpoint.c_str());
+                continue;
+            }
+
+            servers.push_back(std::make_pair(host, static_cast<uint16_t>(port)));
+        }
+
+        return servers;
+    }
+
+    void queueServer(DiscoveryPool &pool, std::shared_ptr<DiscoveryResult> result, const std::string &address,
+                     uint16_t port, double replyMs)
+    {
+        pool.add([this, address, port, replyMs, result]()
         {
-            memset(recvbuff, 0, RECEIVE_BUFFER_SIZE);
+            try
+            {
+                queryServer(address, port, replyMs, *result);
+            }
+            catch (const std::exception &e)
+            {
+                // A malformed reply must not take down the discovery thread and the driver with it.
+                IDLog("Error querying %s:%d: %s\n", address.c_str(), port, e.what());
+            }
+        });
+    }
+
+    void broadcast(DiscoveryPool &pool, std::shared_ptr<DiscoveryResult> result,
+                   std::chrono::steady_clock::time_point started)
+    {
+        IDLog("Sending discovery packets\n");
+
+        int s4 = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        int s6 = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
 
-            int n = recvfrom(s, recvbuff, RECEIVE_BUFFER_SIZE, 0, (sockaddr *)&Recv_addr, &len);
-            if (n < 0)
+        if (s4 == -1 && s6 == -1)
+        {
+            IDLog("Error creating socket\n");
+            return;
+        }
+
+        if (s4 != -1)
+        {
+            int broadcast=1;
+            setsockopt(s4, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+        }
+
+        if (s6 != -1)
+        {
+            int v6only = 1;
+            setsockopt(s6, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+
+        int sent = sendDiscovery(s4, s6);
+
+        IDLog("Sent %d discovery packets\n", sent);
+
+        std::vector<char> recvbuff(RECEIVE_BUFFER_SIZE);
+        std::set<std::string> responders;
+
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+                std::chrono::seconds(ALPACA_DISCOVERY_TIMEOUT);
+
+        // Listen on both families in the same window instead of one timeout per socket.
+        while (true)
+        {
+            int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0)
                 break;
 
-            IDLog("Received: %s\n", recvbuff);
+            struct pollfd fds[2] =
+            {
+                { s4, POLLIN, 0 },
+                { s6, POLLIN, 0 },
+            };
 
-            nlohmann::json doc = nlohmann::json::parse(recvbuff);
+            if (poll(fds, 2, remaining) <= 0)
+                break;
 
-            if (doc.contains("AlpacaPort"))
+            for (auto &fd : fds)
             {
-                char deviceIP[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &(Recv_addr.sin_addr), deviceIP, INET_ADDRSTRLEN);
+                if (fd.fd == -1 || !(fd.revents & POLLIN))
+                    continue;
+
+                struct sockaddr_storage Recv_addr;
+                socklen_t len = sizeof(Recv_addr);
+
+                int n = recvfrom(fd.fd, recvbuff.data(), recvbuff.size() - 1, 0, (sockaddr *)&Recv_addr, &len);
+                if (n < 0)
+                    continue;
+
+                recvbuff[n] = 0;
+
+                IDLog("Received: %s\n", recvbuff.data());
+
+                nlohmann::json doc = nlohmann::json::parse(recvbuff.data(), nullptr, false);
+
+                if (!doc.is_object() || !doc.contains("AlpacaPort") || !doc["AlpacaPort"].is_number_integer())
+                    continue;
+
+                // Numeric host, link-local IPv6 responders get their zone so they stay reachable.
+                char deviceIP[NI_MAXHOST];
+                if (getnameinfo((sockaddr *)&Recv_addr, len, deviceIP, sizeof(deviceIP), nullptr, 0, NI_NUMERICHOST) != 0)
+                    continue;
 
                 int port = doc["AlpacaPort"];
 
+                // A server on several interfaces or on both families answers more than once.
+                if (!responders.insert(std::string(deviceIP) + ":" + std::to_string(port)).second)
+                    continue;
+
                 IDLog("Found Alpaca Device Server at %s:%d\n", deviceIP, port);
 
-                char url[256];
-                memset(url, 0, 256);
-                snprintf(url, 256, "http://%s:%d/management/v1/description", deviceIP, port);
+                // Query servers while still listening for more replies.
+                queueServer(pool, result, deviceIP, port, millisecondsSince(started));
+            }
+        }
 
-                auto doc = get_json(url);
-                if (doc == nullptr)
-                {
-                    return;
-                }
+        if (s4 != -1)
+            close(s4);
+
+        if (s6 != -1)
+            close(s6);
+    }
+
+    // Sends the discovery message on every interface, returns the number of packets sent.
+    int sendDiscovery(int s4, int s6)
+    {
+        static const char sendMSG[] = "alpacadiscovery1";
+
+        int sent = 0;
 
-                std::string serverName = doc["Value"]["ServerName"];
-                std::string manufacturer = doc["Value"]["Manufacturer"];
-                std::string manufacturerVersion = doc["Value"]["ManufacturerVersion"];
-                std::string location = doc["Value"]["Location"];
+        struct ifaddrs *interfaces = nullptr;
+        if (getifaddrs(&interfaces) != 0)
+            interfaces = nullptr;
 
-                IDLog("ServerName: %s\n", serverName.c_str());
-                IDLog("Manufacturer: %s\n", manufacturer.c_str());
-                IDLog("ManufacturerVersion: %s\n", manufacturerVersion.c_str());
-                IDLog("Location: %s\n", location.c_str());
+        std::set<unsigned int> multicastInterfaces;
 
-                IDLog("\n\n");
+        for (struct ifaddrs *ifa = interfaces; ifa != nullptr; ifa = ifa->ifa_next)
+        {
+            if (ifa->ifa_addr == nullptr || !(ifa->ifa_flags & IFF_UP))
+                continue;
 
-                memset(url, 0, 256);
-                snprintf(url, 256, "http://%s:%d/management/v1/configureddevices", deviceIP, port);
+            if (ifa->ifa_addr->sa_family == AF_INET && s4 != -1)
+            {
+                struct sockaddr_in Recv_addr;
+                memset(&Recv_addr, 0, sizeof(Recv_addr));
 
-                doc = get_json(url);
-                if (doc == nullptr)
+                if (ifa->ifa_flags & IFF_LOOPBACK)
                 {
-                    return;
+                    // Loopback has no broadcast, ask a local server directly.
+                    Recv_addr = *(struct sockaddr_in *)ifa->ifa_addr;
                 }
-
-                for (auto &device : doc["Value"])
+                else if ((ifa->ifa_flags & IFF_BROADCAST) && ifa->ifa_broadaddr != nullptr)
                 {
-                    std::string deviceName = device["DeviceName"];
-                    std::string deviceType = device["DeviceType"];
-                    uint32_t deviceNumber = device["DeviceNumber"];
-                    std::string uniqueId = device["UniqueID"];
-
-                    IDLog("Found Device: \n");
-                    IDLog("DeviceName: %s\n", deviceName.c_str());
-                    IDLog("DeviceType: %s\n", deviceType.c_str());
-                    IDLog("DeviceNumber: %d\n", deviceNumber);
-                    IDLog("UniqueID: %s\n\n", uniqueId.c_str());
-
-                    std::transform(deviceType.begin(), deviceType.end(), deviceType.begin(), ::tolower);
-
-                    if (deviceType == "covercalibrator")
-                    {
-                        devices.push_back(std::unique_ptr<AlpacaBase>(new AlpacaCoverCalibrator(serverName, manufacturer, manufacturerVersion, location, deviceName, deviceType, deviceNumber, uniqueId, deviceIP, port)));
-                    }
-                    else if (deviceType == "dome")
-                    {
-                        devices.push_back(std::unique_ptr<AlpacaBase>(new AlpacaDome(serverName, manufacturer, manufacturerVersion, location, deviceName, deviceType, deviceNumber, uniqueId, deviceIP, port)));
-                    }
+                    Recv_addr = *(struct sockaddr_in *)ifa->ifa_broadaddr;
                 }
-                // lights.push_back(std::unique_ptr<DragonLight>(new DragonLight(std::string(str))));
+                else
+                {
+                    continue;
+                }
+
+                Recv_addr.sin_family = AF_INET;
+                Recv_addr.sin_port = htons(ALPACA_DISCOVERY_PORT);
+
+                if (sendto(s4, sendMSG, strlen(sendMSG), 0, (sockaddr *)&Recv_addr, sizeof(Recv_addr)) > 0)
+                    sent++;
+            }
+            else if (ifa->ifa_addr->sa_family == AF_INET6 && s6 != -1 && (ifa->ifa_flags & IFF_MULTICAST))
+            {
+                unsigned int index = if_nametoindex(ifa->ifa_name);
+
+                // Interfaces list one entry per address, multicast once per interface.
+                if (index == 0 || !multicastInterfaces.insert(index).second)
+                    continue;
+
+                struct sockaddr_in6 Recv_addr;
+                memset(&Recv_addr, 0, sizeof(Recv_addr));
+                Recv_addr.sin6_family = AF_INET6;
+                Recv_addr.sin6_port = htons(ALPACA_DISCOVERY_PORT);
+                Recv_addr.sin6_scope_id = index;
+                inet_pton(AF_INET6, ALPACA_DISCOVERY_MULTICAST_IPV6, &Recv_addr.sin6_addr);
+
+                setsockopt(s6, IPPROTO_IPV6, IPV6_MULTICAST_IF, &index, sizeof(index));
+
+                if (sendto(s6, sendMSG, strlen(sendMSG), 0, (sockaddr *)&Recv_addr, sizeof(Recv_addr)) > 0)
+                    sent++;
+            }
+        }
+
+        if (interfaces != nullptr)
+            freeifaddrs(interfaces);
+
+        // Nothing usable was enumerated, fall back to the default route.
+        if (sent == 0 && s4 != -1)
+        {
+            struct sockaddr_in Recv_addr;
+            memset(&Recv_addr, 0, sizeof(Recv_addr));
+            Recv_addr.sin_family       = AF_INET;
+            Recv_addr.sin_port         = htons(ALPACA_DISCOVERY_PORT);
+            Recv_addr.sin_addr.s_addr  = INADDR_BROADCAST;
+
+            if (sendto(s4, sendMSG, strlen(sendMSG), 0, (sockaddr *)&Recv_addr, sizeof(Recv_addr)) > 0)
+                sent++;
+        }
+
+        return sent;
+    }
+
+    void queryServer(const std::string &deviceIP, uint16_t port, double replyMs, DiscoveryResult &result)
+    {
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+        // Held for the whole server so the devices created below share its connections.
+        std::shared_ptr<AlpacaTransport> transport = AlpacaTransport::forServer(deviceIP, port);
+
+        AlpacaRequest description;
+        AlpacaRequest configuredDevices;
+
+        description.method = AlpacaRequest::GET;
+        description.url.append(transport->baseUrl());
+        description.url.append("/management/v1/description");
+
+        configuredDevices.method = AlpacaRequest::GET;
+        configuredDevices.url.append(transport->baseUrl());
+        configuredDevices.url.append("/management/v1/configureddevices");
+
+        // Both management queries are independent, send them together.
+        std::future<AlpacaResponse> pendingDescription = AlpacaRequestEngine::instance().request(transport,
+                std::move(description));
+        std::future<AlpacaResponse> pendingDevices = AlpacaRequestEngine::instance().request(transport,
+                std::move(configuredDevices));
+
+        nlohmann::json doc = pendingDescription.get().document;
+        double descriptionMs = millisecondsSince(started);
+
+        nlohmann::json devicesDoc = pendingDevices.get().document;
+        double configuredDevicesMs = millisecondsSince(started);
+
+        if (doc == nullptr)
+        {
+            IDLog("No description from %s:%d\n", deviceIP.c_str(), port);
+            return;
+        }
+
+        DiscoveredDevice server;
+        server.serverName = doc["Value"]["ServerName"];
+        server.manufacturer = doc["Value"]["Manufacturer"];
+        server.manufacturerVersion = doc["Value"]["ManufacturerVersion"];
+        server.location = doc["Value"]["Location"];
+        server.ipAddress = deviceIP;
+        server.port = port;
+
+        IDLog("ServerName: %s\n", server.serverName.c_str());
+        IDLog("Manufacturer: %s\n", server.manufacturer.c_str());
+        IDLog("ManufacturerVersion: %s\n", server.manufacturerVersion.c_str());
+        IDLog("Location: %s\n", server.location.c_str());
+
+        IDLog("\n\n");
+
+        if (devicesDoc == nullptr)
+        {
+            IDLog("No configured devices from %s:%d\n", deviceIP.c_str(), port);
+            return;
+        }
+
+        for (auto &device : devicesDoc["Value"])
+        {
+            DiscoveredDevice found = server;
+            found.deviceName = device["DeviceName"];
+            found.deviceType = device["DeviceType"];
+            found.deviceNumber = device["DeviceNumber"];
+            found.uniqueId = device["UniqueID"];
+
+            IDLog("Found Device: \n");
+            IDLog("DeviceName: %s\n", found.deviceName.c_str());
+            IDLog("DeviceType: %s\n", found.deviceType.c_str());
+            IDLog("DeviceNumber: %d\n", found.deviceNumber);
+            IDLog("UniqueID: %s\n\n", found.uniqueId.c_str());
+
+            std::transform(found.deviceType.begin(), found.deviceType.end(), found.deviceType.begin(), ::tolower);
+
+            {
+                std::lock_guard<std::mutex> lock(result.mutex);
+                result.uniqueIds.insert(found.uniqueId);
+            }
+
+            // Devices are INDI objects, create them on the INDI thread as soon as each one is known.
+            AlpacaDispatcher::post([this, found]()
+            {
+                addDevice(found, false);
+            });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(result.mutex);
+            result.servers.insert(server.serverKey());
+        }
+
+        IDLog("Server %s:%d timing: reply %.0f ms, description %.0f ms, configureddevices %.0f ms, total %.0f ms, %d devices\n",
+              deviceIP.c_str(), port, replyMs, descriptionMs, configuredDevicesMs, replyMs + millisecondsSince(started),
+              (int)devicesDoc["Value"].size());
+    }
+
+    void addDevice(const DiscoveredDevice &found, bool fromCache)
+    {
+        if (!fromCache)
+            cache["devices"][found.uniqueId] = found.toJson();
+
+        for (auto &existing : devices)
+        {
+            if (existing->uniqueId() == found.uniqueId)
+            {
+                existing->setServerAddress(found.ipAddress, found.port);
+                return;
+            }
+        }
+
+        DefaultDevice *device = nullptr;
+
+        if (found.deviceType == "covercalibrator")
+        {
+            AlpacaCoverCalibrator *coverCalibrator = new AlpacaCoverCalibrator(found.serverName, found.manufacturer, found.manufacturerVersion, found.location, found.deviceName, found.deviceType, found.deviceNumber, found.uniqueId, found.ipAddress, found.port);
+            devices.push_back(std::unique_ptr<AlpacaBase>(coverCalibrator));
+            device = coverCalibrator;
+        }
+        else if (found.deviceType == "dome")
+        {
+            AlpacaDome *dome = new AlpacaDome(found.serverName, found.manufacturer, found.manufacturerVersion, found.location, found.deviceName, found.deviceType, found.deviceNumber, found.uniqueId, found.ipAddress, found.port);
+            devices.push_back(std::unique_ptr<AlpacaBase>(dome));
+            device = dome;
+        }
+
+        // Clients may have asked for properties before this device existed, announce it now.
+        if (device != nullptr)
+            device->ISGetProperties(nullptr);
+    }
+
+    // Evicts devices that are gone from the cache and retires them, then saves the cache.
+    void reconcile(const DiscoveryResult &result)
+    {
+        nlohmann::json &cached = cache["devices"];
+
+        for (auto it = cached.begin(); it != cached.end();)
+        {
+            if (result.uniqueIds.count(it.key()) > 0)
+            {
+                ++it;
+                continue;
+            }
+
+            DiscoveredDevice found = DiscoveredDevice::fromJson(it.value());
+            int misses = it.value().value("Misses", 0) + 1;
+
+            // A server that answered without the device no longer has it, an unreachable one may come back.
+            if (result.servers.count(found.serverKey()) > 0 || misses >= ALPACA_DISCOVERY_CACHE_MAX_MISSES)
+            {
+                IDLog("Evicting %s (%s) from the discovery cache\n", found.deviceName.c_str(), found.uniqueId.c_str());
+                it = cached.erase(it);
+                retireDevice(found.uniqueId);
+                continue;
             }
+
+            IDLog("Cached device %s (%s) was not found at %s\n", found.deviceName.c_str(), found.uniqueId.c_str(),
+                  found.serverKey().c_str());
+            it.value()["Misses"] = misses;
+            ++it;
         }
 
-        IDLog("discovery complete\n");
+        saveJsonFile(cachePath, cache);
+    }
+
+    void retireDevice(const std::string &uniqueId)
+    {
+        for (auto it = devices.begin(); it != devices.end(); ++it)
+        {
+            if ((*it)->uniqueId() == uniqueId)
+            {
+                IDLog("Retiring %s\n", uniqueId.c_str());
+
+                (*it)->retire();
+                devices.erase(it);
+                return;
+            }
+        }
     }
 } loader;
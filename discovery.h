@@ -1,4 +1,5 @@
-#include "jsonRequest.h"
+#include "dispatcher.h"
+#include "transport.h"
 #include "devices/base.h"
 #include "devices/covercalibrator.h"
 #include "devices/dome.h"
@@ -0,0 +1,105 @@
+#include "dispatcher.h"
+
+#include <deque>
+#include <mutex>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <libindi/indidevapi.h>
+
+struct DispatchQueue
+{
+    std::mutex mutex;
+    std::deque<std::function<void()>> items;
+};
+
+// Built on first use, posts already arrive during static initialisation. Never destroyed, background
+// threads may still post while the process exits.
+static DispatchQueue &dispatchQueue()
+{
+    static DispatchQueue *queue = new DispatchQueue();
+
+    return *queue;
+}
+
+static int wakeFds[2] = { -1, -1 };
+
+static void onWake(int fd, void *userp)
+{
+    (void)userp;
+
+    char buffer[64];
+    while (read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+
+    AlpacaDispatcher::drain();
+}
+
+void AlpacaDispatcher::wait(int timeoutMs)
+{
+    if (wakeFds[0] == -1)
+    {
+        drain();
+        return;
+    }
+
+    struct pollfd pfd = { wakeFds[0], POLLIN, 0 };
+    poll(&pfd, 1, timeoutMs);
+
+    onWake(wakeFds[0], nullptr);
+}
+
+void AlpacaDispatcher::init()
+{
+    if (wakeFds[0] != -1)
+        return;
+
+    if (pipe(wakeFds) != 0)
+    {
+        IDLog("Error creating dispatcher pipe\n");
+        wakeFds[0] = wakeFds[1] = -1;
+        return;
+    }
+
+    for (int fd : wakeFds)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    IEAddCallback(wakeFds[0], onWake, nullptr);
+}
+
+void AlpacaDispatcher::post(std::function<void()> fn)
+{
+    DispatchQueue &queue = dispatchQueue();
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.items.push_back(std::move(fn));
+    }
+
+    if (wakeFds[1] != -1)
+    {
+        char c = 0;
+        // A full pipe already guarantees a pending wake up, so a failed write is harmless.
+        ssize_t rc = write(wakeFds[1], &c, 1);
+        (void)rc;
+    }
+}
+
+void AlpacaDispatcher::drain()
+{
+    DispatchQueue &queue = dispatchQueue();
+    std::deque<std::function<void()>> ready;
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        ready.swap(queue.items);
+    }
+
+    for (auto &fn : ready)
+        fn();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <functional>
+
+/**
+ * @brief The AlpacaDispatcher class.
+ *
+ * Hands work from background threads back to the INDI event loop. The INDI API is not thread
+ * safe, so anything touching properties or devices must run through post().
+ */
+class AlpacaDispatcher
+{
+public:
+    // Must be called from the INDI thread before the first post().
+    static void init();
+
+    // Queue fn to run on the INDI thread. Safe to call from any thread.
+    static void post(std::function<void()> fn);
+
+    // Run everything queued so far. Called by the event loop, or directly when there is none.
+    static void drain();
+
+    // Without an event loop: block until something is posted or timeoutMs passes, then drain().
+    static void wait(int timeoutMs);
+};
+
+#endif // DISPATCHER_H
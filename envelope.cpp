@@ -0,0 +1,239 @@
+#include "envelope.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <libindi/json.h>
+
+/**
+ * @brief SAX handler that keeps the top level envelope fields and skips everything nested.
+ */
+class EnvelopeHandler
+{
+public:
+    explicit EnvelopeHandler(AlpacaEnvelope &envelope) : _envelope(envelope), _depth(0), _field(FIELD_OTHER) {}
+
+    bool null()
+    {
+        if (_depth == 1 && _field == FIELD_VALUE)
+            _envelope.valueType = AlpacaEnvelope::VALUE_NULL;
+
+        return true;
+    }
+
+    bool boolean(bool value)
+    {
+        if (_depth == 1 && _field == FIELD_VALUE)
+        {
+            _envelope.valueType = AlpacaEnvelope::VALUE_BOOLEAN;
+            _envelope.boolean = value;
+        }
+
+        return true;
+    }
+
+    bool number_integer(nlohmann::json::number_integer_t value)
+    {
+        setInteger(value);
+        return true;
+    }
+
+    bool number_unsigned(nlohmann::json::number_unsigned_t value)
+    {
+        setInteger(static_cast<int64_t>(value));
+        return true;
+    }
+
+    bool number_float(nlohmann::json::number_float_t value, const nlohmann::json::string_t &)
+    {
+        if (_depth == 1 && _field == FIELD_VALUE)
+        {
+            _envelope.valueType = AlpacaEnvelope::VALUE_NUMBER;
+            _envelope.number = value;
+            _envelope.integer = static_cast<int64_t>(value);
+        }
+
+        return true;
+    }
+
+    bool string(nlohmann::json::string_t &value)
+    {
+        if (_depth != 1)
+            return true;
+
+        if (_field == FIELD_VALUE)
+        {
+            _envelope.valueType = AlpacaEnvelope::VALUE_STRING;
+            copy(_envelope.text, sizeof(_envelope.text), value);
+        }
+        else if (_field == FIELD_ERROR_MESSAGE)
+        {
+            copy(_envelope.errorMessage, sizeof(_envelope.errorMessage), value);
+        }
+
+        return true;
+    }
+
+    template <typename Binary>
+    bool binary(Binary &)
+    {
+        return true;
+    }
+
+    bool start_object(std::size_t)
+    {
+        if (_depth == 1 && _field == FIELD_VALUE)
+            _envelope.valueType = AlpacaEnvelope::VALUE_OBJECT;
+
+        _depth++;
+        return true;
+    }
+
+    bool key(nlohmann::json::string_t &value)
+    {
+        if (_depth != 1)
+            return true;
+
+        if (value == "Value")
+            _field = FIELD_VALUE;
+        else if (value == "ErrorNumber")
+            _field = FIELD_ERROR_NUMBER;
+        else if (value == "ErrorMessage")
+            _field = FIELD_ERROR_MESSAGE;
+        else if (value == "ClientTransactionID")
+            _field = FIELD_CLIENT_TRANSACTION_ID;
+        else if (value == "ServerTransactionID")
+            _field = FIELD_SERVER_TRANSACTION_ID;
+        else
+            _field = FIELD_OTHER;
+
+        return true;
+    }
+
+    bool end_object()
+    {
+        _depth--;
+        return true;
+    }
+
+    bool start_array(std::size_t)
+    {
+        if (_depth == 1 && _field == FIELD_VALUE)
+            _envelope.valueType = AlpacaEnvelope::VALUE_ARRAY;
+
+        _depth++;
+        return true;
+    }
+
+    bool end_array()
+    {
+        _depth--;
+        return true;
+    }
+
+    template <typename Exception>
+    bool parse_error(std::size_t, const std::string &, const Exception &)
+    {
+        return false;
+    }
+
+private:
+    enum Field
+    {
+        FIELD_OTHER,
+        FIELD_VALUE,
+        FIELD_ERROR_NUMBER,
+        FIELD_ERROR_MESSAGE,
+        FIELD_CLIENT_TRANSACTION_ID,
+        FIELD_SERVER_TRANSACTION_ID,
+    };
+
+    void setInteger(int64_t value)
+    {
+        if (_depth != 1)
+            return;
+
+        switch (_field)
+        {
+            case FIELD_VALUE:
+                _envelope.valueType = AlpacaEnvelope::VALUE_INTEGER;
+                _envelope.integer = value;
+                _envelope.number = static_cast<double>(value);
+                break;
+
+            case FIELD_ERROR_NUMBER:
+                _envelope.errorNumber = static_cast<int>(value);
+                break;
+
+            case FIELD_CLIENT_TRANSACTION_ID:
+                _envelope.clientTransactionId = static_cast<uint32_t>(value);
+                break;
+
+            case FIELD_SERVER_TRANSACTION_ID:
+                _envelope.serverTransactionId = static_cast<uint32_t>(value);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    static void copy(char *target, size_t size, const std::string &value)
+    {
+        size_t length = std::min(value.size(), size - 1);
+        memcpy(target, value.data(), length);
+        target[length] = 0;
+    }
+
+private:
+    AlpacaEnvelope &_envelope;
+    int _depth;
+    Field _field;
+};
+
+void AlpacaEnvelope::clear()
+{
+    ok = false;
+    failure = FAILURE_NONE;
+    failureCode = 0;
+    errorNumber = 0;
+    errorMessage[0] = 0;
+    clientTransactionId = 0;
+    serverTransactionId = 0;
+    valueType = VALUE_NONE;
+    boolean = false;
+    integer = 0;
+    number = 0;
+    text[0] = 0;
+}
+
+bool AlpacaEnvelope::asBool() const
+{
+    if (valueType == VALUE_BOOLEAN)
+        return boolean;
+
+    return integer != 0;
+}
+
+int AlpacaEnvelope::asInt() const
+{
+    return static_cast<int>(integer);
+}
+
+double AlpacaEnvelope::asDouble() const
+{
+    return number;
+}
+
+const char *AlpacaEnvelope::asString() const
+{
+    return text;
+}
+
+bool parse_envelope(const char *begin, const char *end, AlpacaEnvelope &envelope)
+{
+    EnvelopeHandler handler(envelope);
+
+    return nlohmann::json::sax_parse(begin, end, &handler);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define ALPACA_ENVELOPE_TEXT_SIZE 512
+#define ALPACA_ENVELOPE_MESSAGE_SIZE 256
+
+/**
+ * @brief The fields of an Alpaca device response, extracted without building a JSON document.
+ *
+ * Only the top level Value, ErrorNumber, ErrorMessage and transaction ids are kept. Array and object
+ * values are skipped and only reported through valueType.
+ */
+struct AlpacaEnvelope
+{
+    enum ValueType
+    {
+        VALUE_NONE,
+        VALUE_NULL,
+        VALUE_BOOLEAN,
+        VALUE_INTEGER,
+        VALUE_NUMBER,
+        VALUE_STRING,
+        VALUE_ARRAY,
+        VALUE_OBJECT,
+    };
+
+    // Why ok is false.
+    enum Failure
+    {
+        FAILURE_NONE,
+        FAILURE_NOT_SENT,    // Rejected before it reached the wire, see AlpacaRequestEngine
+        FAILURE_TRANSPORT,   // Connect or transfer error, failureCode is the CURLcode
+        FAILURE_TIMEOUT,     // Ran into its deadline, see AlpacaDeadlines
+        FAILURE_HTTP_STATUS, // failureCode is the HTTP status
+        FAILURE_BAD_BODY,    // Empty or not JSON
+        FAILURE_MISMATCH,    // ClientTransactionID of another request
+    };
+
+    // False when the request failed, the HTTP status was not 200 or the body was not JSON.
+    bool ok;
+    Failure failure;
+    long failureCode;
+
+    int errorNumber;
+    char errorMessage[ALPACA_ENVELOPE_MESSAGE_SIZE];
+
+    uint32_t clientTransactionId;
+    uint32_t serverTransactionId;
+
+    ValueType valueType;
+    bool boolean;
+    int64_t integer;
+    double number;
+    char text[ALPACA_ENVELOPE_TEXT_SIZE];
+
+    void clear();
+
+    bool asBool() const;
+    int asInt() const;
+    double asDouble() const;
+    const char *asString() const;
+};
+
+// Returns false and leaves envelope.ok unset when the body is not valid JSON.
+bool parse_envelope(const char *begin, const char *end, AlpacaEnvelope &envelope);
+
+#endif // ENVELOPE_H
@@ -0,0 +1,154 @@
+#include "formencoder.h"
+
+#include <cstdio>
+#include <cstring>
+
+AlpacaForm::Parameter *AlpacaForm::next(const char *name, Type type)
+{
+    if (_count == ALPACA_MAX_FORM_PARAMETERS)
+    {
+        _overflowed = true;
+        return nullptr;
+    }
+
+    Parameter *parameter = &_parameters[_count++];
+    parameter->name = name;
+    parameter->type = type;
+
+    return parameter;
+}
+
+void AlpacaForm::add(const char *name, const char *value)
+{
+    Parameter *parameter = next(name, TEXT);
+    if (parameter != nullptr)
+        parameter->text.assign(value);
+}
+
+void AlpacaForm::add(const char *name, const std::string &value)
+{
+    Parameter *parameter = next(name, TEXT);
+    if (parameter != nullptr)
+        parameter->text = value;
+}
+
+void AlpacaForm::add(const char *name, int32_t value)
+{
+    Parameter *parameter = next(name, INTEGER);
+    if (parameter != nullptr)
+        parameter->integer = value;
+}
+
+void AlpacaForm::add(const char *name, uint32_t value)
+{
+    Parameter *parameter = next(name, UNSIGNED);
+    if (parameter != nullptr)
+        parameter->unsignedInteger = value;
+}
+
+void AlpacaForm::add(const char *name, double value)
+{
+    Parameter *parameter = next(name, NUMBER);
+    if (parameter != nullptr)
+        parameter->number = value;
+}
+
+void AlpacaForm::add(const char *name, bool value)
+{
+    Parameter *parameter = next(name, BOOLEAN);
+    if (parameter != nullptr)
+        parameter->boolean = value;
+}
+
+// Grows geometrically and never shrinks, room for the NUL is always kept.
+static void reserve(std::vector<char> &out, size_t needed)
+{
+    if (needed + 1 > out.size())
+        out.resize((needed + 1) * 2);
+}
+
+static void appendChar(std::vector<char> &out, size_t &length, char c)
+{
+    reserve(out, length + 1);
+    out[length++] = c;
+}
+
+// application/x-www-form-urlencoded: unreserved characters pass through, space is '+', the rest %XX.
+static void appendEncoded(std::vector<char> &out, size_t &length, const char *text, size_t size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    // Worst case every byte becomes %XX.
+    reserve(out, length + size * 3);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                c == '-' || c == '.' || c == '_' || c == '~')
+        {
+            out[length++] = c;
+        }
+        else if (c == ' ')
+        {
+            out[length++] = '+';
+        }
+        else
+        {
+            out[length++] = '%';
+            out[length++] = hex[c >> 4];
+            out[length++] = hex[c & 0x0F];
+        }
+    }
+}
+
+size_t AlpacaForm::encode(std::vector<char> &out) const
+{
+    size_t length = 0;
+
+    reserve(out, 0);
+
+    for (size_t i = 0; i < _count; i++)
+    {
+        const Parameter &parameter = _parameters[i];
+
+        if (i > 0)
+            appendChar(out, length, '&');
+
+        appendEncoded(out, length, parameter.name, strlen(parameter.name));
+        appendChar(out, length, '=');
+
+        char value[32];
+        int size = 0;
+
+        switch (parameter.type)
+        {
+        case TEXT:
+            appendEncoded(out, length, parameter.text.data(), parameter.text.size());
+            continue;
+
+        case INTEGER:
+            size = snprintf(value, sizeof(value), "%d", parameter.integer);
+            break;
+
+        case UNSIGNED:
+            size = snprintf(value, sizeof(value), "%u", parameter.unsignedInteger);
+            break;
+
+        case NUMBER:
+            size = snprintf(value, sizeof(value), "%.17g", parameter.number);
+            break;
+
+        case BOOLEAN:
+            size = snprintf(value, sizeof(value), "%s", parameter.boolean ? "True" : "False");
+            break;
+        }
+
+        appendEncoded(out, length, value, size);
+    }
+
+    out[length] = 0;
+
+    return length;
+}
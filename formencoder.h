@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef FORMENCODER_H
+#define FORMENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define ALPACA_MAX_FORM_PARAMETERS 8 // Alpaca PUTs carry a handful of parameters plus the client ids
+
+/**
+ * @brief The AlpacaForm class.
+ *
+ * The parameters of a PUT as a small flat list. Numbers and booleans are kept as values and only formatted
+ * when the body is encoded, so a command such as /calibratoron does not allocate. Names must be string
+ * literals, text values are copied.
+ */
+class AlpacaForm
+{
+public:
+    AlpacaForm() : _count(0), _overflowed(false) {}
+
+    void add(const char *name, const char *value);
+    void add(const char *name, const std::string &value);
+    void add(const char *name, int32_t value);
+    void add(const char *name, uint32_t value);
+    void add(const char *name, double value);
+    // Alpaca expects True or False.
+    void add(const char *name, bool value);
+
+    size_t size() const
+    {
+        return _count;
+    }
+
+    // More than ALPACA_MAX_FORM_PARAMETERS were added, the request is failed instead of sent incomplete.
+    bool overflowed() const
+    {
+        return _overflowed;
+    }
+
+    // Writes name=value&... percent-encoded and NUL terminated into out, returns the length without the NUL.
+    // out keeps its capacity, so a buffer reused across requests stops allocating once it has seen the largest body.
+    size_t encode(std::vector<char> &out) const;
+
+private:
+    enum Type
+    {
+        TEXT,
+        INTEGER,
+        UNSIGNED,
+        NUMBER,
+        BOOLEAN,
+    };
+
+    struct Parameter
+    {
+        const char *name;
+        Type type;
+        std::string text;
+        union
+        {
+            int32_t integer;
+            uint32_t unsignedInteger;
+            double number;
+            bool boolean;
+        };
+    };
+
+    Parameter *next(const char *name, Type type);
+
+private:
+    Parameter _parameters[ALPACA_MAX_FORM_PARAMETERS];
+    size_t _count;
+    bool _overflowed;
+};
+
+#endif // FORMENCODER_H
@@ -3,9 +3,39 @@
 #ifndef JSONREQUEST_H
 #define JSONREQUEST_H
 
+#include <map>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
 #include <libindi/json.h>
 
-nlohmann::json get_json(const char *url);
-nlohmann::json put_json(const char* url, const std::map<std::string, std::string> &body);
+#include "envelope.h"
+#include "formencoder.h"
+
+#define POST_DATA_SIZE 1024 // Initial form body buffer of a connection, grows for larger bodies
+#define RESPONSE_BUFFER_SIZE 4096 // Fits typical Alpaca replies without growing
+
+// Receive buffer owned by a connection and reused by every request on it.
+struct response_t
+{
+    std::vector<char> buffer;
+    size_t size = 0;
+
+    void reset();
+    bool append(const char *data, size_t length);
+};
+
+// Configure a handle owned by the caller for one request. The handle is run by AlpacaRequestEngine
+// and the result collected with finish_json(). The body is encoded into post_data, which must outlive the transfer.
+void prepare_get_json(CURL *curl, const char *url, struct response_t *chunk);
+void prepare_put_json(CURL *curl, const char *url, const AlpacaForm &body, std::vector<char> &post_data,
+                      struct response_t *chunk);
+
+// Full document, for management endpoints.
+nlohmann::json finish_json(CURL *curl, CURLcode res, struct response_t *chunk);
+
+// Only the Alpaca envelope fields, for device endpoints.
+void finish_envelope(CURL *curl, CURLcode res, struct response_t *chunk, AlpacaEnvelope &envelope);
 
 #endif // JSONREQUEST_H
@@ -1,5 +1,8 @@
 #include "jsonRequest.h"
 
+#include <algorithm>
+#include <new>
+
 #include <curl/curl.h>
 #include <libindi/indidevapi.h>
 
@@ -75,111 +78,141 @@ int my_trace(CURL *handle, curl_infotype type,
     return 0;
 }
 
-struct response_t
+void response_t::reset()
 {
-    char *response;
-    size_t size;
-};
+    size = 0;
+
+    if (buffer.empty())
+        buffer.resize(RESPONSE_BUFFER_SIZE);
+
+    buffer[0] = 0;
+}
+
+bool response_t::append(const char *data, size_t length)
+{
+    // Grows geometrically and never shrinks, so a connection stops allocating once it has seen its largest reply.
+    if (size + length + 1 > buffer.size())
+    {
+        size_t capacity = std::max(buffer.size() * 2, size + length + 1);
+
+        try
+        {
+            buffer.resize(capacity);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return false; /* out of memory! */
+        }
+    }
+
+    memcpy(&buffer[size], data, length);
+    size += length;
+    buffer[size] = 0;
+
+    return true;
+}
 
 static size_t cb(void *data, size_t size, size_t nmemb, void *userp)
 {
     size_t realsize        = size * nmemb;
     struct response_t *mem = (struct response_t *)userp;
 
-    char *ptr = (char *)realloc(mem->response, mem->size + realsize + 1);
-    if (ptr == NULL)
-        return 0; /* out of memory! */
-
-    mem->response = ptr;
-    memcpy(&(mem->response[mem->size]), data, realsize);
-    mem->size += realsize;
-    mem->response[mem->size] = 0;
+    if (!mem->append((const char *)data, realsize))
+        return 0;
 
     return realsize;
 }
 
-nlohmann::json get_json(const char *url)
+static void prepare(CURL *curl, const char *url, struct response_t *chunk)
 {
-    CURL *curl;
-    CURLcode res;
+    chunk->reset();
+
+    // Reset clears the options of the previous request but keeps the live connections of the handle.
+    curl_easy_reset(curl);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, chunk);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    // curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
+    // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+}
 
-    curl = curl_easy_init();
-    if (curl)
-    {
-        struct response_t chunk = { .response = nullptr, .size = 0 };
+void prepare_get_json(CURL *curl, const char *url, struct response_t *chunk)
+{
+    prepare(curl, url, chunk);
+}
 
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cb);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &chunk);
-        // curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-        // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+void prepare_put_json(CURL *curl, const char *url, const AlpacaForm &body, std::vector<char> &post_data,
+                      struct response_t *chunk)
+{
+    static struct curl_slist *headers = curl_slist_append(nullptr, "Content-Type: application/x-www-form-urlencoded");
 
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
+    prepare(curl, url, chunk);
 
-        if (res == CURLcode::CURLE_OK)
-        {
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-            if (http_code == 200)
-                return nlohmann::json::parse(chunk.response);
-        }
-    }
+    size_t length = body.encode(post_data);
 
-    return nlohmann::json(nullptr);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data.data());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)length);
 }
 
-nlohmann::json put_json(const char* url, const std::map<std::string, std::string> &body)
+static bool succeeded(CURL *curl, CURLcode res, struct response_t *chunk)
 {
-    CURL *curl;
-    CURLcode res;
+    if (res != CURLcode::CURLE_OK)
+        return false;
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
-    curl = curl_easy_init();
-    if (curl)
+    return http_code == 200 && chunk->size > 0;
+}
+
+void finish_envelope(CURL *curl, CURLcode res, struct response_t *chunk, AlpacaEnvelope &envelope)
+{
+    envelope.clear();
+
+    if (res != CURLcode::CURLE_OK)
     {
-        struct response_t chunk = { .response = nullptr, .size = 0 };
+        envelope.failure = res == CURLE_OPERATION_TIMEDOUT ? AlpacaEnvelope::FAILURE_TIMEOUT :
+                           AlpacaEnvelope::FAILURE_TRANSPORT;
+        envelope.failureCode = res;
+        return;
+    }
 
-        struct curl_slist *headers=NULL; // init to NULL is important
-        curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cb);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &chunk);
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-        // curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-        // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (http_code != 200)
+    {
+        envelope.failure = AlpacaEnvelope::FAILURE_HTTP_STATUS;
+        envelope.failureCode = http_code;
+        return;
+    }
 
-        if (body.size() > 0)
-        {
-            char post_data[1024];
-            memset(post_data, 0, 1024);
-
-            std::map<std::string, std::string>::const_iterator it;
-            for (it = body.begin(); it != body.end(); it++)
-            {
-                strcat(post_data, it->first.c_str());
-                strcat(post_data, "=");
-                strcat(post_data, it->second.c_str());
-                strcat(post_data, "&");
-            }
-
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
-        }
+    const char *begin = chunk->buffer.data();
+    envelope.ok = chunk->size > 0 && parse_envelope(begin, begin + chunk->size, envelope);
+
+    if (!envelope.ok)
+        envelope.failure = AlpacaEnvelope::FAILURE_BAD_BODY;
+}
 
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
+nlohmann::json finish_json(CURL *curl, CURLcode res, struct response_t *chunk)
+{
+    nlohmann::json doc(nullptr);
 
-        if (res == CURLcode::CURLE_OK)
-        {
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (succeeded(curl, res, chunk))
+    {
+        // Parse straight out of the connection buffer, no intermediate copy.
+        const char *begin = chunk->buffer.data();
+        doc = nlohmann::json::parse(begin, begin + chunk->size, nullptr, false);
 
-            if (http_code == 200)
-                return nlohmann::json::parse(chunk.response);
-        }
+        if (doc.is_discarded())
+            doc = nullptr;
     }
 
-    return nlohmann::json(nullptr);
+    return doc;
 }
@@ -0,0 +1,106 @@
+// Mock Alpaca server for running the driver over loopback without hardware.
+//
+//   alpaca_mock_server --covercalibrators 200 --domes 50 --latency-ms 5 --jitter-ms 3 --error-rate 0.01
+//
+// then start the driver with ALPACA_SERVERS=127.0.0.1:11111, or let it discover the server on loopback.
+
+#include "mockserver.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <pthread.h>
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --bind ADDRESS            IPv4 address to listen on (127.0.0.1)\n"
+            "  --port PORT               HTTP port, 0 picks a free one (11111)\n"
+            "  --discovery-port PORT     UDP discovery port, 0 picks a free one, -1 disables discovery (32227)\n"
+            "  --covercalibrators N      CoverCalibrator devices (1)\n"
+            "  --domes N                 Dome devices (1)\n"
+            "  --latency-ms MS           Added to every device request (0)\n"
+            "  --jitter-ms MS            Uniform jitter around the latency (0)\n"
+            "  --error-rate RATE         Share of device requests failing with an Alpaca error (0)\n"
+            "  --http-error-rate RATE    Share of device requests failing with HTTP 500 (0)\n"
+            "  --move-ms MS              Time covers, shutters, calibrators and slews take (2000)\n",
+            program);
+}
+
+int main(int argc, char *argv[])
+{
+    MockAlpacaOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+
+        if (strcmp(option, "--help") == 0 || strcmp(option, "-h") == 0)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        const char *value = argv[++i];
+
+        if (strcmp(option, "--bind") == 0)
+            options.bindAddress = value;
+        else if (strcmp(option, "--port") == 0)
+            options.port = atoi(value);
+        else if (strcmp(option, "--discovery-port") == 0)
+            options.discoveryPort = atoi(value);
+        else if (strcmp(option, "--covercalibrators") == 0)
+            options.coverCalibrators = atoi(value);
+        else if (strcmp(option, "--domes") == 0)
+            options.domes = atoi(value);
+        else if (strcmp(option, "--latency-ms") == 0)
+            options.latencyMs = atoi(value);
+        else if (strcmp(option, "--jitter-ms") == 0)
+            options.jitterMs = atoi(value);
+        else if (strcmp(option, "--error-rate") == 0)
+            options.errorRate = atof(value);
+        else if (strcmp(option, "--http-error-rate") == 0)
+            options.httpErrorRate = atof(value);
+        else if (strcmp(option, "--move-ms") == 0)
+            options.moveMs = atoi(value);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Block the signals before any thread starts so only sigwait below sees them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    MockAlpacaServer server(options);
+    if (!server.start())
+        return 1;
+
+    fprintf(stderr, "Mock Alpaca server on %s:%d with %zu devices, discovery %s\n", options.bindAddress.c_str(),
+            server.port(), server.deviceCount(),
+            server.discoveryPort() != 0 ? std::to_string(server.discoveryPort()).c_str() : "off");
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+
+    server.stop();
+
+    fprintf(stderr, "Served %llu requests\n", (unsigned long long)server.requests());
+
+    return 0;
+}
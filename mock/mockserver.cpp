@@ -0,0 +1,903 @@
+#include "mockserver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MOCK_POLL_MS 200 // How often blocked threads look at the stop flag
+#define MOCK_MAX_REQUEST_SIZE 65536
+
+#define MOCK_MAX_BRIGHTNESS 255
+
+#define ALPACA_ERROR_NOT_IMPLEMENTED 0x400
+#define ALPACA_ERROR_INVALID_VALUE 0x401
+#define ALPACA_ERROR_NOT_CONNECTED 0x407
+#define ALPACA_ERROR_INJECTED 0x500
+
+// CoverStatus, CalibratorStatus and ShutterState of the Alpaca API.
+enum
+{
+    COVER_CLOSED = 1,
+    COVER_MOVING = 2,
+    COVER_OPEN = 3,
+    COVER_UNKNOWN = 4,
+};
+
+enum
+{
+    CALIBRATOR_OFF = 1,
+    CALIBRATOR_NOT_READY = 2,
+    CALIBRATOR_READY = 3,
+};
+
+enum
+{
+    SHUTTER_OPEN = 0,
+    SHUTTER_CLOSED = 1,
+    SHUTTER_OPENING = 2,
+    SHUTTER_CLOSING = 3,
+};
+
+static std::string lower(std::string text)
+{
+    for (char &c : text)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+    return text;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+static std::string urlDecode(const std::string &text)
+{
+    std::string decoded;
+    decoded.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '+')
+        {
+            decoded += ' ';
+        }
+        else if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0)
+        {
+            decoded += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        }
+        else
+        {
+            decoded += text[i];
+        }
+    }
+
+    return decoded;
+}
+
+// Alpaca parameter names are case insensitive.
+static bool findParameter(const std::string &parameters, const char *name, std::string &value)
+{
+    std::string wanted = lower(name);
+    size_t start = 0;
+
+    while (start <= parameters.size())
+    {
+        size_t end = parameters.find('&', start);
+        if (end == std::string::npos)
+            end = parameters.size();
+
+        std::string pair = parameters.substr(start, end - start);
+        size_t equals = pair.find('=');
+
+        if (equals != std::string::npos && lower(urlDecode(pair.substr(0, equals))) == wanted)
+        {
+            value = urlDecode(pair.substr(equals + 1));
+            return true;
+        }
+
+        start = end + 1;
+    }
+
+    return false;
+}
+
+static std::string quote(const std::string &text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+
+    return quoted + "\"";
+}
+
+static std::string boolean(bool value)
+{
+    return value ? "true" : "false";
+}
+
+static std::string number(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.6f", value);
+
+    return text;
+}
+
+static bool sendAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        data += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+MockAlpacaServer::MockAlpacaServer(const MockAlpacaOptions &options)
+    : _options(options), _port(0), _discoveryPort(0), _listenFd(-1), _discoveryFd(-1), _stopping(false), _requests(0),
+      _serverTransactionId(0)
+{
+    for (int i = 0; i < _options.coverCalibrators + _options.domes; i++)
+    {
+        bool cover = i < _options.coverCalibrators;
+
+        Device device;
+        device.type = cover ? "covercalibrator" : "dome";
+        device.number = cover ? i : i - _options.coverCalibrators;
+        device.connected = false;
+
+        char name[64];
+        snprintf(name, sizeof(name), "Mock %s %d", cover ? "CoverCalibrator" : "Dome", device.number);
+        device.name = name;
+
+        // Stable across runs so the driver's caches and profiles recognise the devices.
+        char uniqueId[64];
+        snprintf(uniqueId, sizeof(uniqueId), "mock-%s-%04d", device.type.c_str(), device.number);
+        device.uniqueId = uniqueId;
+
+        device.coverState = COVER_CLOSED;
+        device.coverTarget = COVER_CLOSED;
+        device.calibratorState = CALIBRATOR_OFF;
+        device.brightness = 0;
+
+        device.shutterStatus = SHUTTER_CLOSED;
+        device.shutterTarget = SHUTTER_CLOSED;
+        device.azimuth = 0;
+        device.targetAzimuth = 0;
+        device.slewing = false;
+        device.parking = false;
+        device.homing = false;
+        device.atPark = true;
+        device.atHome = false;
+
+        _devices.push_back(device);
+    }
+}
+
+MockAlpacaServer::~MockAlpacaServer()
+{
+    stop();
+}
+
+bool MockAlpacaServer::start()
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+
+    if (inet_pton(AF_INET, _options.bindAddress.c_str(), &address.sin_addr) != 1)
+    {
+        fprintf(stderr, "mock: invalid bind address %s\n", _options.bindAddress.c_str());
+        return false;
+    }
+
+    int on = 1;
+
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    address.sin_port = htons(_options.port);
+    if (bind(_listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(_listenFd, 128) < 0)
+    {
+        fprintf(stderr, "mock: unable to listen on %s:%d: %s\n", _options.bindAddress.c_str(), _options.port,
+                strerror(errno));
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(_listenFd, (struct sockaddr *)&address, &length);
+    _port = ntohs(address.sin_port);
+
+    if (_options.discoveryPort >= 0)
+    {
+        _discoveryFd = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(_discoveryFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        address.sin_port = htons(_options.discoveryPort);
+        if (bind(_discoveryFd, (struct sockaddr *)&address, sizeof(address)) < 0)
+        {
+            fprintf(stderr, "mock: unable to bind discovery port %d: %s\n", _options.discoveryPort, strerror(errno));
+            close(_discoveryFd);
+            close(_listenFd);
+            _discoveryFd = -1;
+            _listenFd = -1;
+            return false;
+        }
+
+        length = sizeof(address);
+        getsockname(_discoveryFd, (struct sockaddr *)&address, &length);
+        _discoveryPort = ntohs(address.sin_port);
+    }
+
+    _stopping = false;
+    _acceptThread = std::thread(&MockAlpacaServer::acceptLoop, this);
+
+    if (_discoveryFd >= 0)
+        _discoveryThread = std::thread(&MockAlpacaServer::discoveryLoop, this);
+
+    return true;
+}
+
+void MockAlpacaServer::stop()
+{
+    _stopping = true;
+
+    if (_acceptThread.joinable())
+        _acceptThread.join();
+
+    if (_discoveryThread.joinable())
+        _discoveryThread.join();
+
+    if (_listenFd >= 0)
+        close(_listenFd);
+
+    if (_discoveryFd >= 0)
+        close(_discoveryFd);
+
+    _listenFd = -1;
+    _discoveryFd = -1;
+
+    {
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+
+        for (Connection *connection : _connections)
+        {
+            if (connection->fd >= 0)
+                shutdown(connection->fd, SHUT_RDWR);
+        }
+    }
+
+    reapConnections(true);
+}
+
+void MockAlpacaServer::acceptLoop()
+{
+    while (!_stopping)
+    {
+        reapConnections(false);
+
+        struct pollfd pfd = { _listenFd, POLLIN, 0 };
+        if (poll(&pfd, 1, MOCK_POLL_MS) <= 0)
+            continue;
+
+        int fd = accept(_listenFd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Connection *connection = new Connection();
+        connection->fd = fd;
+        connection->done = false;
+
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+        _connections.push_back(connection);
+        connection->thread = std::thread(&MockAlpacaServer::serve, this, connection);
+    }
+}
+
+void MockAlpacaServer::reapConnections(bool all)
+{
+    std::list<Connection *> finished;
+
+    {
+        std::lock_guard<std::mutex> lock(_connectionsMutex);
+
+        for (auto it = _connections.begin(); it != _connections.end();)
+        {
+            if (all || (*it)->done)
+            {
+                finished.push_back(*it);
+                it = _connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (Connection *connection : finished)
+    {
+        connection->thread.join();
+        delete connection;
+    }
+}
+
+void MockAlpacaServer::discoveryLoop()
+{
+    char buffer[512];
+
+    while (!_stopping)
+    {
+        struct pollfd pfd = { _discoveryFd, POLLIN, 0 };
+        if (poll(&pfd, 1, MOCK_POLL_MS) <= 0)
+            continue;
+
+        struct sockaddr_storage from;
+        socklen_t fromLength = sizeof(from);
+
+        ssize_t received = recvfrom(_discoveryFd, buffer, sizeof(buffer) - 1, 0, (struct sockaddr *)&from, &fromLength);
+        if (received <= 0)
+            continue;
+
+        buffer[received] = 0;
+
+        if (strncmp(buffer, "alpacadiscovery1", 16) != 0)
+            continue;
+
+        char reply[64];
+        int length = snprintf(reply, sizeof(reply), "{\"AlpacaPort\":%d}", _port);
+
+        sendto(_discoveryFd, reply, length, 0, (struct sockaddr *)&from, fromLength);
+    }
+}
+
+void MockAlpacaServer::serve(Connection *connection)
+{
+    std::mt19937 random(std::random_device{}());
+    std::string buffer;
+    Request request;
+
+    while (!_stopping && readRequest(connection->fd, buffer, request))
+    {
+        int status = 200;
+        std::string body;
+
+        handle(request, random, status, body);
+
+        char header[256];
+        int length = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                              status, status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" :
+                              "Internal Server Error", status == 200 ? "application/json" : "text/plain", body.size(),
+                              request.keepAlive ? "keep-alive" : "close");
+
+        std::string response(header, length);
+        response += body;
+
+        if (!sendAll(connection->fd, response.data(), response.size()) || !request.keepAlive)
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    close(connection->fd);
+    connection->fd = -1;
+    connection->done = true;
+}
+
+bool MockAlpacaServer::readRequest(int fd, std::string &buffer, Request &request)
+{
+    size_t headerEnd;
+
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (buffer.size() > MOCK_MAX_REQUEST_SIZE || _stopping)
+            return false;
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, MOCK_POLL_MS);
+        if (ready < 0 && errno != EINTR)
+            return false;
+        if (ready <= 0)
+            continue;
+
+        char chunk[4096];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0)
+            return false;
+
+        buffer.append(chunk, received);
+    }
+
+    std::string head = buffer.substr(0, headerEnd);
+
+    // GET /api/v1/dome/0/azimuth?ClientID=1 HTTP/1.1
+    size_t lineEnd = head.find("\r\n");
+    std::string line = head.substr(0, lineEnd);
+
+    size_t methodEnd = line.find(' ');
+    size_t targetEnd = line.find(' ', methodEnd + 1);
+    if (methodEnd == std::string::npos || targetEnd == std::string::npos)
+        return false;
+
+    std::string target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    std::string version = line.substr(targetEnd + 1);
+
+    request.method = line.substr(0, methodEnd);
+
+    size_t queryStart = target.find('?');
+    request.path = lower(target.substr(0, queryStart));
+    request.query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+
+    request.keepAlive = version == "HTTP/1.1";
+    size_t contentLength = 0;
+
+    size_t start = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+    while (start < head.size())
+    {
+        size_t end = head.find("\r\n", start);
+        if (end == std::string::npos)
+            end = head.size();
+
+        std::string header = head.substr(start, end - start);
+        size_t colon = header.find(':');
+
+        if (colon != std::string::npos)
+        {
+            std::string name = lower(header.substr(0, colon));
+            std::string value = header.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+
+            if (name == "content-length")
+                contentLength = strtoul(value.c_str(), nullptr, 10);
+            else if (name == "connection")
+                request.keepAlive = lower(value) != "close";
+        }
+
+        start = end + 2;
+    }
+
+    if (contentLength > MOCK_MAX_REQUEST_SIZE)
+        return false;
+
+    size_t bodyStart = headerEnd + 4;
+
+    while (buffer.size() < bodyStart + contentLength)
+    {
+        if (_stopping)
+            return false;
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, MOCK_POLL_MS);
+        if (ready < 0 && errno != EINTR)
+            return false;
+        if (ready <= 0)
+            continue;
+
+        char chunk[4096];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0)
+            return false;
+
+        buffer.append(chunk, received);
+    }
+
+    request.body = buffer.substr(bodyStart, contentLength);
+    buffer.erase(0, bodyStart + contentLength);
+
+    return true;
+}
+
+std::string MockAlpacaServer::envelope(const std::string &value, uint32_t clientTransactionId, int errorNumber,
+                                       const std::string &errorMessage)
+{
+    std::string body = "{";
+
+    if (!value.empty())
+        body += "\"Value\":" + value + ",";
+
+    body += "\"ClientTransactionID\":" + std::to_string(clientTransactionId);
+    body += ",\"ServerTransactionID\":" + std::to_string(++_serverTransactionId);
+    body += ",\"ErrorNumber\":" + std::to_string(errorNumber);
+    body += ",\"ErrorMessage\":" + quote(errorMessage) + "}";
+
+    return body;
+}
+
+void MockAlpacaServer::handle(const Request &request, std::mt19937 &random, int &status, std::string &body)
+{
+    _requests++;
+
+    bool put = request.method == "PUT";
+    const std::string &parameters = put ? request.body : request.query;
+
+    std::string text;
+    uint32_t clientTransactionId = 0;
+    if (findParameter(parameters, "ClientTransactionID", text))
+        clientTransactionId = strtoul(text.c_str(), nullptr, 10);
+
+    if (request.path.compare(0, 12, "/management/") == 0)
+    {
+        handleManagement(request.path, clientTransactionId, status, body);
+        return;
+    }
+
+    // /api/v1/{device_type}/{device_number}/{action}
+    char type[32];
+    int number = -1;
+    char action[64];
+
+    if (request.path.compare(0, 8, "/api/v1/") != 0 ||
+            sscanf(request.path.c_str() + 8, "%31[^/]/%d/%63s", type, &number, action) != 3)
+    {
+        status = 404;
+        body = "Unknown path " + request.path;
+        return;
+    }
+
+    size_t index;
+    if (strcmp(type, "covercalibrator") == 0 && number >= 0 && number < _options.coverCalibrators)
+        index = number;
+    else if (strcmp(type, "dome") == 0 && number >= 0 && number < _options.domes)
+        index = _options.coverCalibrators + number;
+    else
+    {
+        status = 400;
+        body = "Unknown device " + std::string(type) + "/" + std::to_string(number);
+        return;
+    }
+
+    int delay = _options.latencyMs;
+    if (_options.jitterMs > 0)
+        delay += std::uniform_int_distribution<int>(-_options.jitterMs, _options.jitterMs)(random);
+    if (delay > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+    std::uniform_real_distribution<double> chance(0, 1);
+
+    if (_options.httpErrorRate > 0 && chance(random) < _options.httpErrorRate)
+    {
+        status = 500;
+        body = "Injected failure";
+        return;
+    }
+
+    if (_options.errorRate > 0 && chance(random) < _options.errorRate)
+    {
+        body = envelope("", clientTransactionId, ALPACA_ERROR_INJECTED, "Injected error");
+        return;
+    }
+
+    std::string value;
+    int errorNumber = 0;
+    std::string errorMessage;
+
+    std::lock_guard<std::mutex> lock(_devicesMutex);
+
+    Device &device = _devices[index];
+    settle(device);
+
+    std::string name = action;
+    bool handled = true;
+
+    if (name == "connected")
+    {
+        if (put)
+        {
+            if (findParameter(parameters, "Connected", text))
+                device.connected = lower(text) == "true";
+            else
+            {
+                errorNumber = ALPACA_ERROR_INVALID_VALUE;
+                errorMessage = "Connected is missing";
+            }
+        }
+        else
+        {
+            value = boolean(device.connected);
+        }
+    }
+    else if (!put && name == "description")
+        value = quote(device.name + " simulated by the indi-alpaca mock server");
+    else if (!put && name == "driverinfo")
+        value = quote("indi-alpaca mock server");
+    else if (!put && name == "driverversion")
+        value = quote("1.0");
+    else if (!put && name == "interfaceversion")
+        value = device.type == "dome" ? "2" : "1";
+    else if (!put && name == "name")
+        value = quote(device.name);
+    else if (!put && name == "supportedactions")
+        value = "[]";
+    else if (put && !device.connected)
+    {
+        errorNumber = ALPACA_ERROR_NOT_CONNECTED;
+        errorMessage = "Not connected";
+    }
+    else if (device.type == "covercalibrator")
+        handled = handleCoverCalibrator(device, put, name, request, value, errorNumber, errorMessage);
+    else
+        handled = handleDome(device, put, name, request, value, errorNumber, errorMessage);
+
+    if (!handled)
+    {
+        errorNumber = ALPACA_ERROR_NOT_IMPLEMENTED;
+        errorMessage = request.method + " " + name + " is not implemented";
+    }
+
+    body = envelope(errorNumber == 0 ? value : "", clientTransactionId, errorNumber, errorMessage);
+}
+
+void MockAlpacaServer::handleManagement(const std::string &path, uint32_t clientTransactionId, int &status,
+                                        std::string &body)
+{
+    if (path == "/management/apiversions")
+    {
+        body = envelope("[1]", clientTransactionId, 0, "");
+    }
+    else if (path == "/management/v1/description")
+    {
+        body = envelope("{\"ServerName\":\"Mock Alpaca Server\",\"Manufacturer\":\"indi-alpaca\","
+                        "\"ManufacturerVersion\":\"1.0\",\"Location\":\"Loopback\"}", clientTransactionId, 0, "");
+    }
+    else if (path == "/management/v1/configureddevices")
+    {
+        std::string value = "[";
+
+        std::lock_guard<std::mutex> lock(_devicesMutex);
+
+        for (size_t i = 0; i < _devices.size(); i++)
+        {
+            const Device &device = _devices[i];
+
+            if (i > 0)
+                value += ",";
+
+            value += "{\"DeviceName\":" + quote(device.name) +
+                     ",\"DeviceType\":" + quote(device.type == "dome" ? "Dome" : "CoverCalibrator") +
+                     ",\"DeviceNumber\":" + std::to_string(device.number) +
+                     ",\"UniqueID\":" + quote(device.uniqueId) + "}";
+        }
+
+        value += "]";
+
+        body = envelope(value, clientTransactionId, 0, "");
+    }
+    else
+    {
+        status = 404;
+        body = "Unknown path " + path;
+    }
+}
+
+void MockAlpacaServer::settle(Device &device)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (device.coverState == COVER_MOVING && now >= device.coverDone)
+        device.coverState = device.coverTarget;
+
+    if (device.calibratorState == CALIBRATOR_NOT_READY && now >= device.calibratorDone)
+        device.calibratorState = CALIBRATOR_READY;
+
+    if ((device.shutterStatus == SHUTTER_OPENING || device.shutterStatus == SHUTTER_CLOSING) && now >= device.shutterDone)
+        device.shutterStatus = device.shutterTarget;
+
+    if (device.slewing && now >= device.slewDone)
+    {
+        device.slewing = false;
+        device.azimuth = device.targetAzimuth;
+        device.atPark = device.parking;
+        device.atHome = device.homing;
+        device.parking = false;
+        device.homing = false;
+    }
+}
+
+bool MockAlpacaServer::handleCoverCalibrator(Device &device, bool put, const std::string &action,
+        const Request &request, std::string &value, int &errorNumber, std::string &errorMessage)
+{
+    std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(_options.moveMs);
+
+    if (!put)
+    {
+        if (action == "brightness")
+            value = std::to_string(device.brightness);
+        else if (action == "maxbrightness")
+            value = std::to_string(MOCK_MAX_BRIGHTNESS);
+        else if (action == "calibratorstate")
+            value = std::to_string(device.calibratorState);
+        else if (action == "coverstate")
+            value = std::to_string(device.coverState);
+        else
+            return false;
+
+        return true;
+    }
+
+    if (action == "calibratoron")
+    {
+        std::string text;
+        int brightness = findParameter(request.body, "Brightness", text) ? atoi(text.c_str()) : -1;
+
+        if (brightness < 0 || brightness > MOCK_MAX_BRIGHTNESS)
+        {
+            errorNumber = ALPACA_ERROR_INVALID_VALUE;
+            errorMessage = "Brightness must be between 0 and " + std::to_string(MOCK_MAX_BRIGHTNESS);
+            return true;
+        }
+
+        device.brightness = brightness;
+        device.calibratorState = CALIBRATOR_NOT_READY;
+        device.calibratorDone = done;
+    }
+    else if (action == "calibratoroff")
+    {
+        device.brightness = 0;
+        device.calibratorState = CALIBRATOR_OFF;
+    }
+    else if (action == "opencover" || action == "closecover")
+    {
+        device.coverTarget = action == "opencover" ? COVER_OPEN : COVER_CLOSED;
+        device.coverState = COVER_MOVING;
+        device.coverDone = done;
+    }
+    else if (action == "haltcover")
+    {
+        if (device.coverState == COVER_MOVING)
+            device.coverState = COVER_UNKNOWN;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool MockAlpacaServer::handleDome(Device &device, bool put, const std::string &action, const Request &request,
+                                  std::string &value, int &errorNumber, std::string &errorMessage)
+{
+    std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(_options.moveMs);
+
+    if (!put)
+    {
+        if (action == "altitude")
+            value = number(0);
+        else if (action == "athome")
+            value = boolean(device.atHome);
+        else if (action == "atpark")
+            value = boolean(device.atPark);
+        else if (action == "azimuth")
+            value = number(device.azimuth);
+        else if (action == "shutterstatus")
+            value = std::to_string(device.shutterStatus);
+        else if (action == "slewing")
+            value = boolean(device.slewing);
+        else if (action == "slaved")
+            value = boolean(false);
+        else if (action == "canfindhome" || action == "canpark" || action == "cansetazimuth" ||
+                 action == "cansetshutter" || action == "cansyncazimuth")
+            value = boolean(true);
+        else if (action == "cansetaltitude" || action == "cansetpark" || action == "canslave")
+            value = boolean(false);
+        else
+            return false;
+
+        return true;
+    }
+
+    if (action == "abortslew")
+    {
+        device.slewing = false;
+        device.parking = false;
+        device.homing = false;
+    }
+    else if (action == "openshutter" || action == "closeshutter")
+    {
+        bool open = action == "openshutter";
+
+        device.shutterTarget = open ? SHUTTER_OPEN : SHUTTER_CLOSED;
+        device.shutterStatus = open ? SHUTTER_OPENING : SHUTTER_CLOSING;
+        device.shutterDone = done;
+    }
+    else if (action == "park" || action == "findhome" || action == "slewtoazimuth")
+    {
+        double azimuth = 0;
+
+        if (action == "slewtoazimuth")
+        {
+            std::string text;
+            char *end = nullptr;
+
+            if (findParameter(request.body, "Azimuth", text))
+                azimuth = strtod(text.c_str(), &end);
+
+            if (end == nullptr || end == text.c_str() || azimuth < 0 || azimuth >= 360)
+            {
+                errorNumber = ALPACA_ERROR_INVALID_VALUE;
+                errorMessage = "Azimuth must be between 0 and 360";
+                return true;
+            }
+        }
+
+        device.targetAzimuth = azimuth;
+        device.slewing = true;
+        device.parking = action == "park";
+        device.homing = action == "findhome";
+        device.atPark = false;
+        device.atHome = false;
+        device.slewDone = done;
+    }
+    else if (action == "synctoazimuth")
+    {
+        std::string text;
+
+        if (!findParameter(request.body, "Azimuth", text))
+        {
+            errorNumber = ALPACA_ERROR_INVALID_VALUE;
+            errorMessage = "Azimuth is missing";
+            return true;
+        }
+
+        device.azimuth = strtod(text.c_str(), nullptr);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
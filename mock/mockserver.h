@@ -0,0 +1,171 @@
+#pragma once
+
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MockAlpacaOptions
+{
+    std::string bindAddress = "127.0.0.1";
+    uint16_t port = 11111;     // HTTP, 0 picks a free port
+    int discoveryPort = 32227; // UDP, 0 picks a free port, -1 disables discovery
+
+    int coverCalibrators = 1;
+    int domes = 1;
+
+    // Added to every device request, the jitter is uniform in [-jitterMs, +jitterMs].
+    int latencyMs = 0;
+    int jitterMs = 0;
+
+    // Share of device requests answered with an Alpaca error, and with HTTP 500.
+    double errorRate = 0;
+    double httpErrorRate = 0;
+
+    // Time covers, shutters, calibrators and slews take to settle.
+    int moveMs = 2000;
+};
+
+/**
+ * @brief The MockAlpacaServer class.
+ *
+ * A self-contained Alpaca server for exercising the driver over loopback without hardware. Answers UDP
+ * discovery, the management API and the CoverCalibrator and Dome device APIs, and simulates their motion.
+ * Every connection is served by its own thread so injected latency never holds up other connections.
+ */
+class MockAlpacaServer
+{
+public:
+    explicit MockAlpacaServer(const MockAlpacaOptions &options);
+    ~MockAlpacaServer();
+
+    MockAlpacaServer(const MockAlpacaServer &) = delete;
+    MockAlpacaServer &operator=(const MockAlpacaServer &) = delete;
+
+    // Binds the sockets and starts serving, false when a socket could not be bound.
+    bool start();
+    void stop();
+
+    // The HTTP port actually bound, differs from options.port when it was 0.
+    uint16_t port() const
+    {
+        return _port;
+    }
+
+    // The discovery port actually bound, 0 when discovery is disabled.
+    uint16_t discoveryPort() const
+    {
+        return _discoveryPort;
+    }
+
+    uint64_t requests() const
+    {
+        return _requests;
+    }
+
+    size_t deviceCount() const
+    {
+        return _devices.size();
+    }
+
+private:
+    struct Device
+    {
+        std::string type; // covercalibrator or dome, as in the URL
+        int number;
+        std::string name;
+        std::string uniqueId;
+        bool connected;
+
+        // CoverCalibrator, CoverStatus and CalibratorStatus values.
+        int coverState;
+        int coverTarget;
+        int calibratorState;
+        int brightness;
+
+        // Dome, ShutterState values.
+        int shutterStatus;
+        int shutterTarget;
+        double azimuth;
+        double targetAzimuth;
+        bool slewing;
+        bool parking;
+        bool homing;
+        bool atPark;
+        bool atHome;
+
+        // When the current cover, calibrator, shutter or slew transition completes.
+        std::chrono::steady_clock::time_point coverDone;
+        std::chrono::steady_clock::time_point calibratorDone;
+        std::chrono::steady_clock::time_point shutterDone;
+        std::chrono::steady_clock::time_point slewDone;
+    };
+
+    struct Connection
+    {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done;
+    };
+
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::string body;
+        bool keepAlive;
+    };
+
+    void acceptLoop();
+    void discoveryLoop();
+    void serve(Connection *connection);
+    void reapConnections(bool all);
+
+    bool readRequest(int fd, std::string &buffer, Request &request);
+
+    // Fills status and body for one request.
+    void handle(const Request &request, std::mt19937 &random, int &status, std::string &body);
+    void handleManagement(const std::string &path, uint32_t clientTransactionId, int &status, std::string &body);
+    bool handleCoverCalibrator(Device &device, bool put, const std::string &action, const Request &request,
+                               std::string &value, int &errorNumber, std::string &errorMessage);
+    bool handleDome(Device &device, bool put, const std::string &action, const Request &request,
+                    std::string &value, int &errorNumber, std::string &errorMessage);
+
+    void settle(Device &device);
+
+    std::string envelope(const std::string &value, uint32_t clientTransactionId, int errorNumber,
+                         const std::string &errorMessage);
+
+private:
+    MockAlpacaOptions _options;
+    uint16_t _port;
+    uint16_t _discoveryPort;
+
+    int _listenFd;
+    int _discoveryFd;
+
+    std::atomic<bool> _stopping;
+    std::atomic<uint64_t> _requests;
+    std::atomic<uint32_t> _serverTransactionId;
+
+    std::thread _acceptThread;
+    std::thread _discoveryThread;
+
+    std::mutex _connectionsMutex;
+    std::list<Connection *> _connections;
+
+    // Device state, every request takes the lock while it reads or changes it.
+    std::mutex _devicesMutex;
+    std::vector<Device> _devices;
+};
+
+#endif // MOCKSERVER_H
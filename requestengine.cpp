@@ -0,0 +1,473 @@
+#include "requestengine.h"
+#include "dispatcher.h"
+#include "jsonRequest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+#include <libindi/indidevapi.h>
+
+// A value outside [minimum, maximum], or one that is not a number, would silently change the behaviour, e.g.
+// CURLOPT_TIMEOUT_MS takes 0 as no deadline at all. Those fall back to the default.
+static long environmentValue(const char *name, long fallback, long minimum, long maximum)
+{
+    const char *setting = getenv(name);
+    if (setting == nullptr)
+        return fallback;
+
+    char *end = nullptr;
+    errno = 0;
+    long value = strtol(setting, &end, 10);
+
+    if (end == setting || *end != 0 || errno == ERANGE || value < minimum || value > maximum)
+    {
+        if (maximum == LONG_MAX)
+            IDLog("Ignoring %s=\"%s\", expected a whole number of at least %ld, using %ld\n", name, setting, minimum,
+                  fallback);
+        else
+            IDLog("Ignoring %s=\"%s\", expected a whole number from %ld to %ld, using %ld\n", name, setting, minimum,
+                  maximum, fallback);
+        return fallback;
+    }
+
+    return value;
+}
+
+static long environmentMs(const char *name, long fallback)
+{
+    return environmentValue(name, fallback, 1, LONG_MAX);
+}
+
+AlpacaDeadlines AlpacaDeadlines::fromEnvironment()
+{
+    AlpacaDeadlines deadlines;
+    deadlines.connectTimeoutMs = environmentMs("ALPACA_CONNECT_TIMEOUT_MS", ALPACA_CONNECT_TIMEOUT_MS);
+    deadlines.timeoutMs[AlpacaRequest::ABORT] = environmentMs("ALPACA_ABORT_TIMEOUT_MS", ALPACA_ABORT_TIMEOUT_MS);
+    deadlines.timeoutMs[AlpacaRequest::COMMAND] = environmentMs("ALPACA_COMMAND_TIMEOUT_MS", ALPACA_COMMAND_TIMEOUT_MS);
+    deadlines.timeoutMs[AlpacaRequest::POLL] = environmentMs("ALPACA_POLL_TIMEOUT_MS", ALPACA_POLL_TIMEOUT_MS);
+    // 0 leaves hedging off.
+    deadlines.hedgePercentile = environmentValue("ALPACA_HEDGE_PERCENTILE", 0, 0, 100) / 100.0;
+    deadlines.hedgeMinMs = environmentValue("ALPACA_HEDGE_MIN_MS", ALPACA_HEDGE_MIN_MS, 0, LONG_MAX);
+
+    return deadlines;
+}
+
+struct AlpacaRequestEngine::Transfer
+{
+    std::shared_ptr<AlpacaTransport> transport;
+    AlpacaRequest request;
+    AlpacaConnection *connection;
+    // Second attempt of a slow GET, null unless one is running.
+    AlpacaConnection *hedge;
+
+    std::chrono::steady_clock::time_point queued;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point hedgeAt;
+    std::chrono::steady_clock::time_point hedgeStarted;
+
+    // Asynchronous requests complete through the callback, the others through the promise.
+    Callback callback;
+    std::promise<AlpacaResponse> promise;
+    bool hasPromise;
+};
+
+AlpacaRequestEngine &AlpacaRequestEngine::instance()
+{
+    // Never destroyed, the engine thread may still be running while the process exits.
+    static AlpacaRequestEngine *engine = new AlpacaRequestEngine();
+
+    return *engine;
+}
+
+AlpacaRequestEngine::AlpacaRequestEngine()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    _deadlines = AlpacaDeadlines::fromEnvironment();
+
+    if (_deadlines.hedgePercentile > 0)
+        IDLog("Hedging Alpaca GETs slower than the %.0fth percentile\n", _deadlines.hedgePercentile * 100);
+
+    _multi = curl_multi_init();
+    _thread = std::thread(&AlpacaRequestEngine::run, this);
+}
+
+void AlpacaRequestEngine::submit(std::shared_ptr<AlpacaTransport> transport, AlpacaRequest request, Callback callback)
+{
+    Transfer *transfer = new Transfer();
+    transfer->transport = transport;
+    transfer->request = std::move(request);
+    transfer->connection = nullptr;
+    transfer->hedge = nullptr;
+    transfer->callback = std::move(callback);
+    transfer->hasPromise = false;
+
+    enqueue(transfer);
+}
+
+AlpacaResponse AlpacaRequestEngine::perform(std::shared_ptr<AlpacaTransport> transport, AlpacaRequest request)
+{
+    return this->request(transport, std::move(request)).get();
+}
+
+std::future<AlpacaResponse> AlpacaRequestEngine::request(std::shared_ptr<AlpacaTransport> transport,
+        AlpacaRequest request)
+{
+    Transfer *transfer = new Transfer();
+    transfer->transport = transport;
+    transfer->request = std::move(request);
+    transfer->connection = nullptr;
+    transfer->hedge = nullptr;
+
+    std::future<AlpacaResponse> future = transfer->promise.get_future();
+    transfer->hasPromise = true;
+
+    enqueue(transfer);
+
+    return future;
+}
+
+void AlpacaRequestEngine::enqueue(Transfer *transfer)
+{
+    transfer->queued = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _incoming.push_back(transfer);
+    }
+
+    curl_multi_wakeup(_multi);
+}
+
+void AlpacaRequestEngine::start(Transfer *transfer)
+{
+    transfer->started = std::chrono::steady_clock::now();
+
+    if (transfer->request.url.overflowed())
+    {
+        IDLog("Alpaca request URL longer than %d bytes, not sent: %s\n", ALPACA_URL_SIZE, transfer->request.url.c_str());
+        transfer->connection = nullptr;
+    }
+    else if (transfer->request.body.overflowed())
+    {
+        IDLog("Alpaca request with more than %d parameters, not sent: %s\n", ALPACA_MAX_FORM_PARAMETERS,
+              transfer->request.url.c_str());
+        transfer->connection = nullptr;
+    }
+    else
+    {
+        transfer->connection = transfer->transport->acquire();
+    }
+
+    if (transfer->connection == nullptr)
+    {
+        _servers[transfer->transport.get()].inFlight--;
+
+        std::unique_ptr<AlpacaResponse> response(new AlpacaResponse());
+        response->envelope.clear();
+        response->envelope.failure = AlpacaEnvelope::FAILURE_NOT_SENT;
+        response->timing = AlpacaTiming();
+        response->timing.transactionId = transfer->request.transactionId;
+        complete(transfer, std::move(response));
+        return;
+    }
+
+    AlpacaConnection *connection = transfer->connection;
+
+    if (transfer->request.method == AlpacaRequest::PUT)
+        prepare_put_json(connection->curl, transfer->request.url.c_str(), transfer->request.body, connection->postData,
+                         &connection->response);
+    else
+        prepare_get_json(connection->curl, transfer->request.url.c_str(), &connection->response);
+
+    // A half dead device would otherwise hold the connection until the TCP timeout of the system.
+    curl_easy_setopt(connection->curl, CURLOPT_CONNECTTIMEOUT_MS, _deadlines.connectTimeoutMs);
+    curl_easy_setopt(connection->curl, CURLOPT_TIMEOUT_MS, _deadlines.timeoutMs[transfer->request.priority]);
+
+    curl_easy_setopt(connection->curl, CURLOPT_PRIVATE, transfer);
+    curl_multi_add_handle(_multi, connection->curl);
+
+    // Only GETs are safe to send twice.
+    if (transfer->request.method == AlpacaRequest::GET && _deadlines.hedgePercentile > 0)
+    {
+        int64_t thresholdUs = transfer->transport->hedgeThresholdUs(_deadlines.hedgePercentile);
+
+        if (thresholdUs > 0)
+        {
+            transfer->hedgeAt = transfer->started + std::max(std::chrono::microseconds(thresholdUs),
+                                std::chrono::microseconds(std::chrono::milliseconds(_deadlines.hedgeMinMs)));
+            _hedgeable.push_back(transfer);
+        }
+    }
+}
+
+void AlpacaRequestEngine::startHedge(Transfer *transfer)
+{
+    AlpacaConnection *connection = transfer->transport->acquire();
+    if (connection == nullptr)
+        return;
+
+    _servers[transfer->transport.get()].inFlight++;
+    transfer->hedge = connection;
+    transfer->hedgeStarted = std::chrono::steady_clock::now();
+    transfer->transport->recordHedge();
+
+    prepare_get_json(connection->curl, transfer->request.url.c_str(), &connection->response);
+
+    // The deadline of the first attempt still bounds the request, the hedge only gets what is left of it.
+    std::chrono::milliseconds elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            std::chrono::steady_clock::now() - transfer->started);
+    long remainingMs = std::max(1L, long(_deadlines.timeoutMs[transfer->request.priority] - elapsed.count()));
+
+    curl_easy_setopt(connection->curl, CURLOPT_CONNECTTIMEOUT_MS, std::min(_deadlines.connectTimeoutMs, remainingMs));
+    curl_easy_setopt(connection->curl, CURLOPT_TIMEOUT_MS, remainingMs);
+
+    curl_easy_setopt(connection->curl, CURLOPT_PRIVATE, transfer);
+    curl_multi_add_handle(_multi, connection->curl);
+}
+
+int AlpacaRequestEngine::startDueHedges(int maxMs)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int waitMs = maxMs;
+
+    for (auto it = _hedgeable.begin(); it != _hedgeable.end();)
+    {
+        Transfer *transfer = *it;
+
+        if (now < transfer->hedgeAt)
+        {
+            int dueMs = std::chrono::duration_cast<std::chrono::milliseconds>(transfer->hedgeAt - now).count() + 1;
+            waitMs = std::min(waitMs, dueMs);
+            ++it;
+            continue;
+        }
+
+        // A hedge is a poll, it must not take the connections kept free for commands and aborts.
+        ServerQueue &server = _servers[transfer->transport.get()];
+        int limit = ALPACA_MAX_SERVER_CONNECTIONS - AlpacaRequest::POLL * ALPACA_RESERVED_CONNECTIONS;
+
+        // Without a spare connection the first attempt carries on alone.
+        if (server.inFlight < limit)
+            startHedge(transfer);
+
+        it = _hedgeable.erase(it);
+    }
+
+    return waitMs;
+}
+
+void AlpacaRequestEngine::finish(CURL *curl, CURLcode res)
+{
+    Transfer *transfer = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&transfer);
+
+    curl_multi_remove_handle(_multi, curl);
+
+    // Either attempt of a hedged GET may finish first.
+    bool isHedge = transfer->hedge != nullptr && transfer->hedge->curl == curl;
+    AlpacaConnection *connection = isHedge ? transfer->hedge : transfer->connection;
+    AlpacaConnection *other = isHedge ? transfer->connection : transfer->hedge;
+
+    std::unique_ptr<AlpacaResponse> response(new AlpacaResponse());
+    bool ok;
+    bool mismatched = false;
+
+    if (transfer->request.parse == AlpacaRequest::ENVELOPE)
+    {
+        finish_envelope(curl, res, &connection->response, response->envelope);
+
+        // A reply carrying another ClientTransactionID is stale or crossed with a concurrent request, never
+        // decode it as this one. Servers that do not echo the id send 0 and are trusted.
+        uint32_t echoed = response->envelope.clientTransactionId;
+        if (response->envelope.ok && transfer->request.transactionId != 0 && echoed != 0 &&
+                echoed != transfer->request.transactionId)
+        {
+            IDLog("Alpaca reply for transaction %u received for transaction %u, dropped: %s\n", echoed,
+                  transfer->request.transactionId, transfer->request.url.c_str());
+            response->envelope.ok = false;
+            response->envelope.failure = AlpacaEnvelope::FAILURE_MISMATCH;
+            mismatched = true;
+        }
+
+        ok = response->envelope.ok;
+    }
+    else
+    {
+        response->envelope.clear();
+        response->document = finish_json(curl, res, &connection->response);
+        ok = response->document != nullptr;
+    }
+
+    timeTransfer(transfer, curl, response->timing);
+    response->bytes = transferSize(curl);
+
+    transfer->transport->record(curl, ok, mismatched, res == CURLE_OPERATION_TIMEDOUT, response->timing);
+    transfer->transport->release(connection);
+    _servers[transfer->transport.get()].inFlight--;
+
+    if (isHedge)
+        transfer->hedge = nullptr;
+    else
+        transfer->connection = nullptr;
+
+    // The other attempt may still get through.
+    if (!ok && other != nullptr)
+        return;
+
+    if (other != nullptr)
+    {
+        curl_multi_remove_handle(_multi, other->curl);
+        transfer->transport->release(other);
+        _servers[transfer->transport.get()].inFlight--;
+    }
+
+    if (isHedge && ok)
+        transfer->transport->recordHedgeWon();
+
+    complete(transfer, std::move(response));
+}
+
+void AlpacaRequestEngine::timeTransfer(Transfer *transfer, CURL *curl, AlpacaTiming &timing)
+{
+    curl_off_t pretransfer = 0;
+    curl_off_t startTransfer = 0;
+    curl_off_t total = 0;
+
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+
+    // A failed transfer never reaches the first byte.
+    if (startTransfer < pretransfer)
+        startTransfer = pretransfer;
+    if (total < startTransfer)
+        total = startTransfer;
+
+    // A hedge answered, count the time the first attempt ran before it was sent as waiting.
+    std::chrono::steady_clock::time_point started = transfer->started;
+    if (transfer->hedge != nullptr && transfer->hedge->curl == curl)
+        started = transfer->hedgeStarted;
+
+    timing.transactionId = transfer->request.transactionId;
+    timing.queued = std::chrono::duration_cast<std::chrono::microseconds>(started - transfer->queued).count();
+    timing.connect = pretransfer;
+    timing.server = startTransfer - pretransfer;
+    timing.transfer = total - startTransfer;
+    timing.total = total;
+}
+
+uint64_t AlpacaRequestEngine::transferSize(CURL *curl)
+{
+    long requestHeaders = 0;
+    long responseHeaders = 0;
+    curl_off_t uploaded = 0;
+    curl_off_t downloaded = 0;
+
+    curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &requestHeaders);
+    curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &responseHeaders);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+
+    return requestHeaders + responseHeaders + uploaded + downloaded;
+}
+
+void AlpacaRequestEngine::complete(Transfer *transfer, std::unique_ptr<AlpacaResponse> response)
+{
+    _hedgeable.erase(std::remove(_hedgeable.begin(), _hedgeable.end(), transfer), _hedgeable.end());
+
+    if (transfer->hasPromise)
+    {
+        transfer->promise.set_value(std::move(*response));
+    }
+    else if (transfer->callback)
+    {
+        Callback callback = std::move(transfer->callback);
+        std::shared_ptr<AlpacaResponse> completed(response.release());
+
+        AlpacaDispatcher::post([callback, completed]()
+        {
+            callback(*completed);
+        });
+    }
+
+    delete transfer;
+}
+
+void AlpacaRequestEngine::run()
+{
+    while (true)
+    {
+        std::deque<Transfer *> incoming;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            incoming.swap(_incoming);
+        }
+
+        for (Transfer *transfer : incoming)
+        {
+            ServerQueue &server = _servers[transfer->transport.get()];
+            if (!server.transport)
+            {
+                server.transport = transfer->transport;
+                server.inFlight = 0;
+            }
+
+            server.pending[transfer->request.priority].push_back(transfer);
+        }
+
+        for (auto it = _servers.begin(); it != _servers.end();)
+        {
+            ServerQueue &server = it->second;
+            bool drained = true;
+
+            for (int priority = 0; priority < AlpacaRequest::PRIORITY_LEN; priority++)
+            {
+                std::deque<Transfer *> &pending = server.pending[priority];
+                int limit = ALPACA_MAX_SERVER_CONNECTIONS - priority * ALPACA_RESERVED_CONNECTIONS;
+
+                while (!pending.empty() && server.inFlight < limit)
+                {
+                    Transfer *transfer = pending.front();
+                    pending.pop_front();
+                    server.inFlight++;
+                    start(transfer);
+                }
+
+                drained = drained && pending.empty();
+            }
+
+            if (drained && server.inFlight == 0)
+                it = _servers.erase(it);
+            else
+                ++it;
+        }
+
+        int running = 0;
+        curl_multi_perform(_multi, &running);
+
+        bool finished = false;
+
+        CURLMsg *msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(_multi, &queued)) != nullptr)
+        {
+            if (msg->msg == CURLMSG_DONE)
+            {
+                finish(msg->easy_handle, msg->data.result);
+                finished = true;
+            }
+        }
+
+        int waitMs = startDueHedges(1000);
+
+        // Completed transfers free up connection slots, start the queued requests right away.
+        if (finished)
+            continue;
+
+        curl_multi_poll(_multi, nullptr, 0, waitMs, nullptr);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#ifndef REQUESTENGINE_H
+#define REQUESTENGINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+#include <libindi/json.h>
+
+#include "envelope.h"
+#include "requesturl.h"
+#include "transport.h"
+
+// Requests in flight at once per Alpaca server, small devices only serve a few sockets.
+#define ALPACA_MAX_SERVER_CONNECTIONS 5
+// Kept free for each priority above a class, so an abort never waits for a command or a poll to finish and a
+// command never waits for a poll. Polls get ALPACA_MAX_SERVER_CONNECTIONS - 2 connections.
+#define ALPACA_RESERVED_CONNECTIONS 1
+
+// Deadlines, overridden by the environment variables of AlpacaDeadlines::fromEnvironment().
+#define ALPACA_CONNECT_TIMEOUT_MS 3000
+#define ALPACA_ABORT_TIMEOUT_MS 5000
+#define ALPACA_COMMAND_TIMEOUT_MS 10000
+#define ALPACA_POLL_TIMEOUT_MS 5000
+#define ALPACA_HEDGE_MIN_MS 100 // Never hedge a GET sooner than this, whatever the percentile says
+
+struct AlpacaRequest
+{
+    enum Method
+    {
+        GET,
+        PUT,
+    };
+
+    // Device endpoints only need the envelope, management endpoints get the full document.
+    enum Parse
+    {
+        DOCUMENT,
+        ENVELOPE,
+    };
+
+    // Queued requests of a server start highest priority first.
+    enum Priority
+    {
+        ABORT,
+        COMMAND,
+        POLL,
+        PRIORITY_LEN,
+    };
+
+    Method method;
+    Parse parse = DOCUMENT;
+    Priority priority = POLL;
+    AlpacaUrl url;
+    // ClientTransactionID sent with the request, the reply must echo it. 0 when none was sent.
+    uint32_t transactionId = 0;
+    AlpacaForm body;
+};
+
+/**
+ * @brief Per request class deadlines and the hedging of slow GETs, read once from the environment.
+ *
+ * ALPACA_CONNECT_TIMEOUT_MS, ALPACA_ABORT_TIMEOUT_MS, ALPACA_COMMAND_TIMEOUT_MS and ALPACA_POLL_TIMEOUT_MS
+ * set the deadlines. ALPACA_HEDGE_PERCENTILE (e.g. 95) enables hedging: a GET still running after that
+ * percentile of the recent round trips of its server, and at least ALPACA_HEDGE_MIN_MS, is sent again on
+ * another connection and the first answer wins.
+ */
+struct AlpacaDeadlines
+{
+    long connectTimeoutMs;
+    long timeoutMs[AlpacaRequest::PRIORITY_LEN];
+
+    double hedgePercentile; // 0 to 1, 0 disables hedging
+    long hedgeMinMs;
+
+    static AlpacaDeadlines fromEnvironment();
+};
+
+struct AlpacaResponse
+{
+    nlohmann::json document;
+    AlpacaEnvelope envelope;
+    AlpacaTiming timing;
+    // Sent and received, headers included.
+    uint64_t bytes = 0;
+};
+
+/**
+ * @brief The AlpacaRequestEngine class.
+ *
+ * A single curl_multi loop running on its own thread that carries the requests of every
+ * AlpacaBase in the process, so a slow device never holds up the others. Asynchronous requests
+ * complete on the INDI thread through AlpacaDispatcher.
+ */
+class AlpacaRequestEngine
+{
+public:
+    typedef std::function<void(AlpacaResponse &response)> Callback;
+
+public:
+    static AlpacaRequestEngine &instance();
+
+    // Queue a request, callback runs on the INDI thread once it completes.
+    void submit(std::shared_ptr<AlpacaTransport> transport, AlpacaRequest request, Callback callback);
+
+    // Queue a request and block the calling thread until it completes.
+    AlpacaResponse perform(std::shared_ptr<AlpacaTransport> transport, AlpacaRequest request);
+
+    // Queue a request, the future is fulfilled on the engine thread. Never wait on it from a callback.
+    std::future<AlpacaResponse> request(std::shared_ptr<AlpacaTransport> transport, AlpacaRequest request);
+
+private:
+    struct Transfer;
+
+    struct ServerQueue
+    {
+        std::shared_ptr<AlpacaTransport> transport;
+        std::deque<Transfer *> pending[AlpacaRequest::PRIORITY_LEN];
+        int inFlight;
+    };
+
+    AlpacaRequestEngine();
+    ~AlpacaRequestEngine() = default;
+
+    void enqueue(Transfer *transfer);
+    void run();
+    void start(Transfer *transfer);
+    void startHedge(Transfer *transfer);
+    // Hedges every GET that is due and returns the milliseconds until the next one is, at most maxMs.
+    int startDueHedges(int maxMs);
+    void finish(CURL *curl, CURLcode res);
+    void timeTransfer(Transfer *transfer, CURL *curl, AlpacaTiming &timing);
+    static uint64_t transferSize(CURL *curl);
+    void complete(Transfer *transfer, std::unique_ptr<AlpacaResponse> response);
+
+private:
+    CURLM *_multi;
+    std::thread _thread;
+    AlpacaDeadlines _deadlines;
+
+    std::mutex _mutex;
+    std::deque<Transfer *> _incoming;
+
+    // Only touched by the engine thread.
+    std::map<AlpacaTransport *, ServerQueue> _servers;
+    // GETs in flight that are hedged if they run past their hedgeAt.
+    std::vector<Transfer *> _hedgeable;
+};
+
+#endif // REQUESTENGINE_H
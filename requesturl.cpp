@@ -0,0 +1,50 @@
+#include "requesturl.h"
+
+#include <cstring>
+
+void AlpacaUrl::clear()
+{
+    _data[0] = 0;
+    _length = 0;
+    _overflowed = false;
+}
+
+bool AlpacaUrl::append(const char *text, size_t length)
+{
+    if (_overflowed || _length + length >= ALPACA_URL_SIZE)
+    {
+        _overflowed = true;
+        return false;
+    }
+
+    memcpy(_data + _length, text, length);
+    _length += length;
+    _data[_length] = 0;
+
+    return true;
+}
+
+bool AlpacaUrl::append(const char *text)
+{
+    return append(text, strlen(text));
+}
+
+bool AlpacaUrl::appendNumber(uint32_t value)
+{
+    // Digits come out in reverse, 10 is enough for any uint32_t.
+    char digits[10];
+    size_t count = 0;
+
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    }
+    while (value > 0);
+
+    char text[10];
+    for (size_t i = 0; i < count; i++)
+        text[i] = digits[count - 1 - i];
+
+    return append(text, count);
+}
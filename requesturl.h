@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef REQUESTURL_H
+#define REQUESTURL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define ALPACA_URL_SIZE 256 // Fits a bracketed IPv6 host with zone, the device path and the query string
+
+/**
+ * @brief The AlpacaUrl class.
+ *
+ * A request URL written into a fixed buffer, so building one per poll never allocates. Appending past
+ * the end of the buffer marks the URL as overflowed and the request is failed instead of being sent truncated.
+ */
+class AlpacaUrl
+{
+public:
+    AlpacaUrl()
+    {
+        clear();
+    }
+
+    void clear();
+
+    bool append(const char *text, size_t length);
+    bool append(const char *text);
+    bool append(const std::string &text)
+    {
+        return append(text.data(), text.size());
+    }
+    bool appendNumber(uint32_t value);
+
+    bool assign(const char *text)
+    {
+        clear();
+        return append(text);
+    }
+
+    const char *c_str() const
+    {
+        return _data;
+    }
+    size_t length() const
+    {
+        return _length;
+    }
+    bool overflowed() const
+    {
+        return _overflowed;
+    }
+
+private:
+    char _data[ALPACA_URL_SIZE];
+    size_t _length;
+    bool _overflowed;
+};
+
+#endif // REQUESTURL_H
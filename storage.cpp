@@ -0,0 +1,65 @@
+#include "storage.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include <libindi/indidevapi.h>
+
+std::string alpacaStoragePath(const char *fileName)
+{
+    const char *home = getenv("HOME");
+
+    std::string directory = std::string(home != nullptr ? home : "/tmp") + "/.indi";
+    mkdir(directory.c_str(), 0755);
+
+    return directory + "/" + fileName;
+}
+
+nlohmann::json loadJsonFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return nlohmann::json(nullptr);
+
+    nlohmann::json doc = nlohmann::json::parse(file, nullptr, false);
+    if (doc.is_discarded())
+    {
+        IDLog("Ignoring malformed %s\n", path.c_str());
+        return nlohmann::json(nullptr);
+    }
+
+    return doc;
+}
+
+bool saveJsonFile(const std::string &path, const nlohmann::json &doc)
+{
+    std::string temporary = path + ".tmp";
+
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        if (!file.is_open())
+        {
+            IDLog("Error writing %s\n", temporary.c_str());
+            return false;
+        }
+
+        file << doc.dump(2);
+
+        if (!file.good())
+        {
+            IDLog("Error writing %s\n", temporary.c_str());
+            return false;
+        }
+    }
+
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        IDLog("Error replacing %s\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
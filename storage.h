@@ -0,0 +1,19 @@
+#pragma once
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <string>
+
+#include <libindi/json.h>
+
+// Path of a file kept next to the INDI configuration files, ~/.indi/<fileName>.
+std::string alpacaStoragePath(const char *fileName);
+
+// Returns null when the file is missing or unreadable.
+nlohmann::json loadJsonFile(const std::string &path);
+
+// Writes to a temporary file first so a crash never leaves a truncated file behind.
+bool saveJsonFile(const std::string &path, const nlohmann::json &doc);
+
+#endif // STORAGE_H
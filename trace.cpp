@@ -0,0 +1,86 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <ctime>
+
+AlpacaTrace &AlpacaTrace::instance()
+{
+    // Never destroyed, requests may still complete while the process exits.
+    static AlpacaTrace *trace = new AlpacaTrace();
+
+    return *trace;
+}
+
+AlpacaTrace::AlpacaTrace() : _next(0)
+{
+    for (Slot &slot : _slots)
+        slot.sequence.store(0, std::memory_order_relaxed);
+}
+
+static void copyName(char *to, const char *from)
+{
+    strncpy(to, from, ALPACA_TRACE_NAME_SIZE - 1);
+    to[ALPACA_TRACE_NAME_SIZE - 1] = 0;
+}
+
+void AlpacaTrace::record(const char *device, bool put, const char *endpoint, uint32_t transactionId, int32_t status,
+                         int64_t latencyUs)
+{
+    uint64_t ticket = _next.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _slots[ticket % ALPACA_TRACE_RECORDS];
+
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    AlpacaTraceRecord &record = slot.record;
+    record.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+    record.latencyUs = latencyUs;
+    record.transactionId = transactionId;
+    record.status = status;
+    record.put = put;
+    copyName(record.device, device);
+    copyName(record.endpoint, endpoint);
+
+    slot.sequence.store(2 * (ticket + 1), std::memory_order_release);
+}
+
+size_t AlpacaTrace::dump(FILE *file) const
+{
+    uint64_t end = _next.load(std::memory_order_acquire);
+    uint64_t begin = end > ALPACA_TRACE_RECORDS ? end - ALPACA_TRACE_RECORDS : 0;
+    size_t written = 0;
+
+    for (uint64_t ticket = begin; ticket < end; ticket++)
+    {
+        const Slot &slot = _slots[ticket % ALPACA_TRACE_RECORDS];
+
+        // Skip records still being written or already overwritten by a newer request.
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * (ticket + 1))
+            continue;
+
+        AlpacaTraceRecord record;
+        memcpy(&record, &slot.record, sizeof(record));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        time_t seconds = record.timestampUs / 1000000;
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+        fprintf(file, "%s.%06dZ %s %s %s tx=%" PRIu32 " status=%" PRId32 " latency=%.3fms\n", timestamp,
+                int(record.timestampUs % 1000000), record.device, record.put ? "PUT" : "GET", record.endpoint,
+                record.transactionId, record.status, record.latencyUs / 1000.0);
+        written++;
+    }
+
+    return written;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#define ALPACA_TRACE_RECORDS 4096 // Power of two, about 400 KB
+#define ALPACA_TRACE_NAME_SIZE 32
+
+// One completed request. Names longer than ALPACA_TRACE_NAME_SIZE are truncated.
+struct AlpacaTraceRecord
+{
+    int64_t timestampUs; // Completion, microseconds since the epoch
+    int64_t latencyUs;
+    uint32_t transactionId;
+    int32_t status; // 0 ok, -1 transport or HTTP failure, otherwise the Alpaca ErrorNumber
+    bool put;
+    char device[ALPACA_TRACE_NAME_SIZE];
+    char endpoint[ALPACA_TRACE_NAME_SIZE];
+};
+
+/**
+ * @brief The AlpacaTrace class.
+ *
+ * Always on, in-memory trace of the last ALPACA_TRACE_RECORDS requests of the driver. Writers claim a slot
+ * with a single atomic increment and never wait, each slot carries a sequence number so a dump running at
+ * the same time skips records that are half written instead of blocking the writer.
+ */
+class AlpacaTrace
+{
+public:
+    static AlpacaTrace &instance();
+
+    void record(const char *device, bool put, const char *endpoint, uint32_t transactionId, int32_t status,
+                int64_t latencyUs);
+
+    // Oldest first, returns the number of records written.
+    size_t dump(FILE *file) const;
+
+private:
+    struct Slot
+    {
+        // Odd while the record is being written, 2 * (ticket + 1) once ticket is complete.
+        std::atomic<uint64_t> sequence;
+        AlpacaTraceRecord record;
+    };
+
+    AlpacaTrace();
+
+private:
+    std::atomic<uint64_t> _next;
+    Slot _slots[ALPACA_TRACE_RECORDS];
+};
+
+#endif // TRACE_H
@@ -0,0 +1,157 @@
+#include "transport.h"
+
+#include <algorithm>
+
+std::shared_ptr<AlpacaTransport> AlpacaTransport::forServer(const std::string &ipAddress, uint16_t port)
+{
+    // Local so the discovery thread started during static initialisation never sees them unconstructed.
+    static std::mutex registryMutex;
+    static std::map<std::string, std::weak_ptr<AlpacaTransport>> registry;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    std::string key = ipAddress + ":" + std::to_string(port);
+
+    std::shared_ptr<AlpacaTransport> transport = registry[key].lock();
+    if (!transport)
+    {
+        transport = std::make_shared<AlpacaTransport>(ipAddress, port);
+        registry[key] = transport;
+    }
+
+    return transport;
+}
+
+AlpacaTransport::AlpacaTransport(const std::string &ipAddress, uint16_t port)
+    : _ipAddress(ipAddress), _port(port), _stats()
+{
+    std::string host = _ipAddress;
+
+    if (host.find(':') != std::string::npos)
+    {
+        size_t zone = host.find('%');
+        if (zone != std::string::npos)
+            host.replace(zone, 1, "%25");
+
+        host = "[" + host + "]";
+    }
+
+    _baseUrl = "http://" + host + ":" + std::to_string(_port);
+}
+
+AlpacaTransport::~AlpacaTransport()
+{
+    for (AlpacaConnection *connection : _idle)
+    {
+        curl_easy_cleanup(connection->curl);
+        delete connection;
+    }
+}
+
+AlpacaConnection *AlpacaTransport::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_idle.empty())
+        {
+            AlpacaConnection *connection = _idle.back();
+            _idle.pop_back();
+            return connection;
+        }
+    }
+
+    CURL *curl = curl_easy_init();
+    if (curl == nullptr)
+        return nullptr;
+
+    AlpacaConnection *connection = new AlpacaConnection();
+    connection->curl = curl;
+    connection->response.reset();
+    connection->postData.resize(POST_DATA_SIZE);
+
+    return connection;
+}
+
+void AlpacaTransport::release(AlpacaConnection *connection)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _idle.push_back(connection);
+}
+
+void AlpacaTransport::record(CURL *curl, bool ok, bool mismatched, bool timedOut, const AlpacaTiming &timing)
+{
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+
+    if (ok)
+    {
+        _recentUs[_recentNext] = timing.total;
+        _recentNext = (_recentNext + 1) % ALPACA_HEDGE_SAMPLES;
+
+        if (_recentCount < ALPACA_HEDGE_SAMPLES)
+            _recentCount++;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _stats.requests++;
+
+    if (!ok)
+        _stats.failures++;
+
+    if (mismatched)
+        _stats.mismatches++;
+
+    if (timedOut)
+        _stats.timeouts++;
+
+    _stats.queuedUs += timing.queued;
+    _stats.networkUs += timing.connect + timing.transfer;
+    _stats.serverUs += timing.server;
+
+    if (uint64_t(timing.total) > _stats.maxTotalUs)
+        _stats.maxTotalUs = timing.total;
+
+    if (connects > 0)
+        _stats.connectionsOpened += connects;
+    else if (ok)
+        _stats.connectionsReused++;
+}
+
+void AlpacaTransport::recordHedge()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _stats.hedges++;
+}
+
+void AlpacaTransport::recordHedgeWon()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _stats.hedgesWon++;
+}
+
+int64_t AlpacaTransport::hedgeThresholdUs(double percentile) const
+{
+    // A few samples would make every slightly slow request look like an outlier.
+    if (_recentCount < ALPACA_HEDGE_SAMPLES / 2)
+        return 0;
+
+    int64_t samples[ALPACA_HEDGE_SAMPLES];
+    std::copy(_recentUs, _recentUs + _recentCount, samples);
+
+    size_t index = std::min(_recentCount - 1, size_t(percentile * _recentCount));
+    std::nth_element(samples, samples + index, samples + _recentCount);
+
+    return samples[index];
+}
+
+AlpacaTransport::Stats AlpacaTransport::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _stats;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "jsonRequest.h"
+
+#define ALPACA_HEDGE_SAMPLES 64 // Recent request times of a server the hedge threshold is taken from
+
+// Where the time of one request went, in microseconds.
+struct AlpacaTiming
+{
+    uint32_t transactionId;
+    int64_t queued;   // Waiting in the engine for a free connection slot
+    int64_t connect;  // Name lookup and TCP connect, close to 0 on a reused connection
+    int64_t server;   // Request sent until the first response byte, the device plus one network round trip
+    int64_t transfer; // Receiving the response body
+    int64_t total;    // On the wire, connect + server + transfer
+};
+
+// A pooled curl handle together with the buffers its requests reuse.
+struct AlpacaConnection
+{
+    CURL *curl;
+    struct response_t response;
+    std::vector<char> postData;
+};
+
+/**
+ * @brief The AlpacaTransport class.
+ *
+ * One transport exists per Alpaca server (ip address and port). It keeps a pool of connections,
+ * curl easy handles with their receive buffers, alive between requests and keeps the connection
+ * statistics of the server. The requests themselves are carried by AlpacaRequestEngine, whose
+ * connection cache keeps the TCP connections to the server alive so that every device on it
+ * shares them instead of paying a handshake per call.
+ */
+class AlpacaTransport
+{
+public:
+    struct Stats
+    {
+        uint64_t requests;
+        uint64_t failures;
+        uint64_t connectionsOpened;
+        uint64_t connectionsReused;
+
+        // Replies whose ClientTransactionID answered another request.
+        uint64_t mismatches;
+
+        // Requests that ran into their deadline, see AlpacaDeadlines.
+        uint64_t timeouts;
+
+        // Second attempts of slow GETs, and how many of them answered first.
+        uint64_t hedges;
+        uint64_t hedgesWon;
+
+        // Sums over every request, divide by requests for the mean.
+        uint64_t queuedUs;
+        uint64_t networkUs;
+        uint64_t serverUs;
+        uint64_t maxTotalUs;
+    };
+
+public:
+    static std::shared_ptr<AlpacaTransport> forServer(const std::string &ipAddress, uint16_t port);
+
+    AlpacaTransport(const std::string &ipAddress, uint16_t port);
+    ~AlpacaTransport();
+
+    AlpacaTransport(const AlpacaTransport &) = delete;
+    AlpacaTransport &operator=(const AlpacaTransport &) = delete;
+
+    Stats stats() const;
+
+    const std::string &ipAddress() const
+    {
+        return _ipAddress;
+    }
+    uint16_t port() const
+    {
+        return _port;
+    }
+
+    // http://host:port, with IPv6 addresses bracketed and their zone escaped.
+    const std::string &baseUrl() const
+    {
+        return _baseUrl;
+    }
+
+private:
+    friend class AlpacaRequestEngine;
+
+    AlpacaConnection *acquire();
+    void release(AlpacaConnection *connection);
+    void record(CURL *curl, bool ok, bool mismatched, bool timedOut, const AlpacaTiming &timing);
+    void recordHedge();
+    void recordHedgeWon();
+
+    // Round trip at the given percentile (0 to 1) of the recent successful requests, 0 until there are enough
+    // of them. Engine thread only, like the samples.
+    int64_t hedgeThresholdUs(double percentile) const;
+
+private:
+    std::string _ipAddress;
+    uint16_t _port;
+    std::string _baseUrl;
+
+    mutable std::mutex _mutex;
+    std::vector<AlpacaConnection *> _idle;
+    Stats _stats;
+
+    int64_t _recentUs[ALPACA_HEDGE_SAMPLES];
+    size_t _recentCount = 0;
+    size_t _recentNext = 0;
+};
+
+#endif // TRANSPORT_H